@@ -18,6 +18,7 @@
 namespace app_nvs {
 using addr_t                    = blue::HeartMonitor::addr_t;
 using name_map_key_t            = uint8_t;
+using short_addr_t              = uint16_t;
 static constexpr auto ADDR_SIZE = blue::HeartMonitor::ADDR_SIZE;
 
 /**
@@ -38,6 +39,15 @@ esp_err_t nvs_init();
 esp_err_t get_name_map_key(name_map_key_t *key_ptr);;
 
 esp_err_t set_name_map_key(name_map_key_t key);;
+
+/**
+ * @brief get the short address leased by the hub
+ * @param [out] short_addr_ptr the pointer to the short address
+ * @return error code
+ */
+esp_err_t get_short_addr(short_addr_t *short_addr_ptr);
+
+esp_err_t set_short_addr(short_addr_t short_addr);
 }
 
 #endif // BLE_LORA_ADAPTER_APP_NVS_H
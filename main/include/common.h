@@ -22,8 +22,10 @@ namespace pin {
   constexpr auto DIO2 = GPIO_NUM_2;
 }
 
-static const char *BLE_CHAR_WHITE_LIST_UUID = "12a481f0-9384-413d-b002-f8660566d3b0";
-static const char *BLE_CHAR_DEVICE_UUID     = "a2f05114-fdb6-4549-ae2a-845b4be1ac48";
+static const char *BLE_CHAR_WHITE_LIST_UUID  = "12a481f0-9384-413d-b002-f8660566d3b0";
+static const char *BLE_CHAR_DEVICE_UUID      = "a2f05114-fdb6-4549-ae2a-845b4be1ac48";
+// `HrLoRa::diagnostics_response`, refreshed on read
+static const char *BLE_CHAR_DIAGNOSTICS_UUID = "5c6e2d4a-8f1b-4e37-9a0c-3b7d1f6e8a52";
 static const char *BLE_STANDARD_HR_SERVICE_UUID = "180d";
 static const char *BLE_STANDARD_HR_CHAR_UUID    = "2a37";
 static const char *BLE_CHAR_HR_SERVICE_UUID     = BLE_STANDARD_HR_SERVICE_UUID;
@@ -33,10 +35,88 @@ constexpr auto SCAN_TIME                        = std::chrono::milliseconds(2500
 // scan time + sleep time
 constexpr auto SCAN_TOTAL_TIME = std::chrono::milliseconds(5000);
 static_assert(SCAN_TOTAL_TIME > SCAN_TIME);
+// fallback to random access after missing this many beacons in a row
+constexpr auto TDMA_MAX_MISSED_BEACONS = 3;
+
+// forward the frames overheard from other repeaters to the hub
+// only useful for the repeaters close to the hub
+constexpr auto RELAY_ENABLED        = false;
+constexpr auto RELAY_CACHE_SIZE     = 16;
+constexpr auto RELAY_QUEUE_SIZE     = 4;
+// the same frame seen again in this period is treated as a duplicate
+constexpr auto RELAY_DEDUPE_TTL     = std::chrono::milliseconds(800);
+// a relay is delayed randomly in [0, RELAY_MAX_DELAY]
+constexpr auto RELAY_MAX_DELAY      = std::chrono::milliseconds(200);
+// at most RELAY_AIRTIME_BUDGET could be spent on relaying in every RELAY_AIRTIME_WINDOW (i.e. 10% duty cycle)
+constexpr auto RELAY_AIRTIME_WINDOW = std::chrono::milliseconds(10'000);
+constexpr auto RELAY_AIRTIME_BUDGET = std::chrono::milliseconds(1'000);
+static_assert(RELAY_AIRTIME_WINDOW > RELAY_AIRTIME_BUDGET);
+// the keys of the overheard repeaters whose sequence numbers are counted (debug log only).
+// A larger key shares the counters of `key % OVERHEARD_SEQ_KEYS`.
+constexpr size_t OVERHEARD_SEQ_KEYS = 16;
+
+// remember the recently handled command id, to acknowledge the retransmission without applying it again
+constexpr auto COMMAND_CACHE_SIZE = 8;
+constexpr auto COMMAND_CACHE_TTL  = std::chrono::milliseconds(30'000);
+// a response (or an ack) is sent in the TDMA slot. Before the first beacon, it's delayed randomly
+// in [0, REPLY_MAX_JITTER] instead, so that the repeaters answering a broadcast don't transmit at once.
+constexpr auto REPLY_MAX_JITTER = std::chrono::milliseconds(200);
+// the repeaters listed in a roster answer in the order of their positions, REPLY_RANK_SPACING apart,
+// which is longer than the airtime of an ack
+constexpr auto REPLY_RANK_SPACING = std::chrono::milliseconds(30);
+constexpr auto REPLY_QUEUE_SIZE   = 4;
+
+// report the heart rate only when it moves beyond REPORT_DEAD_BAND (bpm) from the last reported one,
+// or after REPORT_MAX_SILENCE without any report (so the hub knows the repeater is alive)
+constexpr uint8_t REPORT_DEAD_BAND = 2;
+constexpr auto REPORT_MAX_SILENCE  = std::chrono::milliseconds(10'000);
+// crossing any of these (bpm) is always reported immediately, and raises an `hr_alarm`
+constexpr uint8_t REPORT_LOW_THRESHOLD  = 50;
+constexpr uint8_t REPORT_HIGH_THRESHOLD = 180;
+// an `hr_alarm` is sent out of the TDMA slot once the channel is free (CAD).
+// After ALARM_MAX_ATTEMPTS busy channels, it's sent anyway.
+constexpr auto ALARM_MAX_ATTEMPTS = 3;
+// a random delay in [0, ALARM_MAX_BACKOFF] after a busy channel
+constexpr auto ALARM_MAX_BACKOFF  = std::chrono::milliseconds(40);
+constexpr auto ALARM_QUEUE_SIZE   = 4;
+// an alarm is cleared only once the heart rate is ALARM_REARM_BAND (bpm) back within the threshold,
+// and an alarm of the same level is raised at most once every ALARM_MIN_INTERVAL,
+// so that a heart rate wandering around a threshold doesn't flood the channel
+constexpr uint8_t ALARM_REARM_BAND = 5;
+constexpr auto ALARM_MIN_INTERVAL  = std::chrono::milliseconds(10'000);
+
+// the received packets waiting for the parser task. Further packets are dropped.
+constexpr size_t RX_POOL_SIZE = 4;
+// the frames waiting for the radio task to transmit (e.g. the responses from the parser task)
+constexpr auto TX_QUEUE_SIZE  = 2;
+// the radio task only moves the packets in and out, so it preempts the parser
+constexpr auto RADIO_TASK_PRIORITY = 6;
+constexpr auto PARSE_TASK_PRIORITY = 4;
+
+// the default window of `hr_aggregate`, which the hub could change with `set_report_mode`
+constexpr auto AGGREGATE_WINDOW = std::chrono::seconds(60);
+// the frames other than `hr_data` (e.g. `hrv_summary`, `hr_aggregate`) waiting for the TDMA slot
+constexpr auto SLOT_FRAME_QUEUE_SIZE = 4;
+// the largest of them, i.e. a response bundled with its ack
+constexpr size_t SLOT_FRAME_MAX_SIZE = 96;
+
+// compute HRV from the RR intervals on the repeater, and send `hrv_summary` every HRV_SUMMARY_INTERVAL
+constexpr auto HRV_ENABLED          = true;
+constexpr auto HRV_SUMMARY_INTERVAL = std::chrono::milliseconds(30'000);
+// the windows in beats, at most HRV_MAX_WINDOW
+constexpr uint16_t HRV_RMSSD_WINDOW = 64;
+constexpr uint16_t HRV_SDNN_WINDOW  = 128;
+constexpr size_t HRV_MAX_WINDOW     = 128;
+static_assert(HRV_RMSSD_WINDOW <= HRV_MAX_WINDOW && HRV_SDNN_WINDOW <= HRV_MAX_WINDOW);
+
+// log the radio metrics and the latency histograms every DEBUG_DUMP_INTERVAL, off the radio,
+// the parser and the BLE tasks (which only record into them). 0 to disable.
+constexpr auto DEBUG_DUMP_INTERVAL = std::chrono::seconds(300);
 
 static constexpr auto PREF_PARTITION_LABEL = "st";
 static constexpr auto PREF_NAME_MAP_KEY_WORD8_KEY = "nmk";
 static constexpr auto PREF_ADDR_BLOB_KEY   = "addr";
+static constexpr auto PREF_SHORT_ADDR_WORD16_KEY = "saddr";
 }
 
 #endif // BLE_LORA_ADAPTER_COMMON_H
@@ -0,0 +1,26 @@
+#ifndef BLE_LORA_ADAPTER_DIAGNOSTICS_CHAR_CALLBACK_H
+#define BLE_LORA_ADAPTER_DIAGNOSTICS_CHAR_CALLBACK_H
+
+#include <functional>
+#include <NimBLEDevice.h>
+#include "hr_lora.h"
+
+/**
+ * @brief answer a read of the diagnostics characteristic with a fresh `HrLoRa::diagnostics_response`
+ */
+class DiagnosticsCallback : public NimBLECharacteristicCallbacks {
+public:
+  std::function<HrLoRa::diagnostics_response::t()> on_request = nullptr;
+  void onRead(NimBLECharacteristic *pCharacteristic, NimBLEConnInfo &connInfo) override {
+    constexpr auto TAG = "DiagnosticsCallback";
+    if (on_request == nullptr) {
+      ESP_LOGW(TAG, "on_request is not set");
+      return;
+    }
+    uint8_t buf[HrLoRa::diagnostics_response::size_needed()];
+    auto sz = HrLoRa::diagnostics_response::marshal(on_request(), buf, sizeof(buf));
+    pCharacteristic->setValue(buf, sz);
+  }
+};
+
+#endif // BLE_LORA_ADAPTER_DIAGNOSTICS_CHAR_CALLBACK_H
@@ -15,6 +15,7 @@
 // include all the dependencies
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp32/rom/gpio.h"
 #include "soc/rtc.h"
 #include "soc/spi_reg.h"
@@ -23,6 +24,8 @@
 #include "hal/gpio_hal.h"
 #include "esp_timer.h"
 #include "esp_log.h"
+#include "power.h"
+#include "trace.h"
 
 // define Arduino-style macros
 #define LOW                      (0x0)
@@ -54,24 +57,114 @@ uint32_t getApbFrequency();
 
 uint32_t spiFrequencyToClockDiv(uint32_t freq);
 
+/**
+ * @brief see `ESPHal::enableBusyInterrupt`
+ */
+struct busy_wait_config_t {
+  /// spin on BUSY up to this long, as blocking and waking a task costs about the same.
+  /// Most of the SPI commands release BUSY within a few microseconds.
+  uint32_t spin_us          = 50;
+  /// block on the interrupt at most this long each time. RadioLib keeps reading BUSY
+  /// until its own SPI timeout.
+  uint32_t block_timeout_ms = 20;
+};
+
 // create a new ESP-IDF hardware abstraction layer
 // the HAL must inherit from the base RadioLibHal class
 // and implement all of its virtual methods
 // this is pretty much just copied from Arduino ESP32 core
+//
+// one instance for each radio (i.e. `Module`). The instances share `SPI_HOST`, and should
+// be given the same SCK/MISO/MOSI but their own CS, DIO1 and BUSY.
 class ESPHal : public RadioLibHal {
 private:
   // the HAL can contain any additional private members
   static constexpr decltype(SPI2_HOST) SPI_HOST = SPI2_HOST;
+  // the number of the instances on `SPI_HOST`. The first one initializes the bus and the last one frees it.
+  static inline int busUsers = 0;
+  // whether this instance is counted in `busUsers`, i.e. the bus is initialized
+  bool busCounted = false;
+  // the callbacks of RadioLib (see `attachInterrupt`), by GPIO
+  static inline void (*radiolibIsrs[GPIO_NUM_MAX])() = {};
   int8_t spiSCK;
   int8_t spiMISO;
   int8_t spiMOSI;
-  spi_device_handle_t spi;
+  // the CS of the radio, driven by RadioLib
+  uint32_t csPin;
+  spi_device_handle_t spi = nullptr;
+  // the bus is held from CS low to CS high, so that the other instances
+  // don't clock their commands into this radio
+  bool busHeld = false;
+  // the CPU stays at the max frequency (and awake) during a SPI command
+  power::Lock spiLock{ESP_PM_CPU_FREQ_MAX, "radio_spi"};
+
+  // see `enableBusyInterrupt`
+  uint32_t busyPin           = RADIOLIB_NC;
+  SemaphoreHandle_t busySem  = nullptr;
+  busy_wait_config_t busyCfg = {};
+  // BUSY is not a wakeup source, so no light sleep while blocking on it
+  power::Lock busyLock{ESP_PM_NO_LIGHT_SLEEP, "radio_busy"};
+  trace::Histogram busyWaitTime{"busy_wait"};
+
+  // a delay up to this long is spun, as a timer and a context switch cost about as much.
+  // A longer one blocks, which releases the CPU (and allows light sleep).
+  static constexpr uint32_t DELAY_SPIN_MAX_US = 100;
+  // see `delayMicroseconds`. Created on the first blocking delay.
+  esp_timer_handle_t delayTimer = nullptr;
+  SemaphoreHandle_t delaySem    = nullptr;
+
+  static void busyIsr(void *arg);
+
+  bool initDelayTimer() {
+    if (delaySem == nullptr) {
+      delaySem = xSemaphoreCreateBinary();
+      if (delaySem == nullptr) {
+        return false;
+      }
+    }
+    if (delayTimer == nullptr) {
+      esp_timer_create_args_t args = {
+          .callback              = [](void *arg) { xSemaphoreGive(static_cast<SemaphoreHandle_t>(arg)); },
+          .arg                   = delaySem,
+          .dispatch_method       = ESP_TIMER_TASK,
+          .name                  = "radio_delay",
+          .skip_unhandled_events = false,
+      };
+      if (esp_timer_create(&args, &delayTimer) != ESP_OK) {
+        delayTimer = nullptr;
+        return false;
+      }
+    }
+    return true;
+  }
+  static void radiolibIsr(void *arg);
+
+  template <typename T, void (*Isr)(T *)>
+  static void IRAM_ATTR isrThunk(void *arg) {
+    Isr(static_cast<T *>(arg));
+  }
+
+  void acquireBus() {
+    if (spi != nullptr && !busHeld) {
+      // acquire finite time not supported now
+      spi_device_acquire_bus(spi, portMAX_DELAY);
+      busHeld = true;
+    }
+  }
+
+  void releaseBus() {
+    if (busHeld) {
+      spi_device_release_bus(spi);
+      busHeld = false;
+    }
+  }
 
 public:
   // default constructor - initializes the base HAL and any needed private members
-  ESPHal(int8_t sck, int8_t miso, int8_t mosi)
+  // `cs` is needed to share the bus with other instances; `RADIOLIB_NC` if this is the only one
+  ESPHal(int8_t sck, int8_t miso, int8_t mosi, uint32_t cs = RADIOLIB_NC)
       : RadioLibHal(INPUT, OUTPUT, LOW, HIGH, RISING, FALLING),
-        spiSCK(sck), spiMISO(miso), spiMOSI(mosi) {
+        spiSCK(sck), spiMISO(miso), spiMOSI(mosi), csPin(cs) {
   }
 
   void init() override {
@@ -80,8 +173,15 @@ public:
   }
 
   void term() override {
-    // we only need to stop the SPI here
     spiEnd();
+    if (delayTimer != nullptr) {
+      esp_timer_delete(delayTimer);
+      delayTimer = nullptr;
+    }
+    if (delaySem != nullptr) {
+      vSemaphoreDelete(delaySem);
+      delaySem = nullptr;
+    }
   }
 
   // GPIO-related methods (pinMode, digitalWrite etc.) should check
@@ -109,7 +209,13 @@ public:
       return;
     }
 
+    if (pin == csPin && value == LOW) {
+      acquireBus();
+    }
     gpio_set_level((gpio_num_t)pin, value);
+    if (pin == csPin && value == HIGH) {
+      releaseBus();
+    }
   }
 
   uint32_t digitalRead(uint32_t pin) override {
@@ -117,20 +223,65 @@ public:
       return (0);
     }
 
+    // RadioLib only reads BUSY to wait for it to go low, polling with `yield`
+    if (pin == busyPin && gpio_get_level((gpio_num_t)pin)) {
+      waitBusy(busyCfg.block_timeout_ms);
+    }
     return (gpio_get_level((gpio_num_t)pin));
   }
 
+  /**
+   * @brief wait for BUSY with an interrupt instead of polling, which releases the CPU
+   *        to BLE and the other tasks during the mode transitions of the radio
+   * @note `digitalRead` of `pin` would block (up to `block_timeout_ms`) until it's low
+   * @note the ISR is registered with this instance as the argument
+   */
+  esp_err_t enableBusyInterrupt(uint32_t pin, const busy_wait_config_t &config = {});
+
+  /**
+   * @brief spin for `spin_us` and then block on the BUSY interrupt until it's low
+   * @return whether BUSY is low, i.e. false on timeout
+   */
+  bool waitBusy(uint32_t timeout_ms);
+
+  /**
+   * @brief the time spent in `waitBusy`, to tune `busy_wait_config_t::spin_us`
+   */
+  [[nodiscard]] const trace::Histogram &busyWaitHistogram() const {
+    return busyWaitTime;
+  }
+
   void attachInterrupt(uint32_t interruptNum, void (*interruptCb)(), uint32_t mode) override {
     if (interruptNum == RADIOLIB_NC) {
       return;
     }
 
-    gpio_install_isr_service((int)ESP_INTR_FLAG_IRAM);
-    gpio_set_intr_type((gpio_num_t)interruptNum, (gpio_int_type_t)(mode & 0x7));
+    // the callback of RadioLib takes no argument. Instead of casting the function type,
+    // the ISR is given the slot holding the callback.
+    radiolibIsrs[interruptNum] = interruptCb;
+    attachInterruptArg(interruptNum, radiolibIsr, &radiolibIsrs[interruptNum], mode);
+  }
 
-    // this uses function typecasting, which is not defined when the functions have different signatures
-    // untested and might not work
-    gpio_isr_handler_add((gpio_num_t)interruptNum, (void (*)(void *))interruptCb, nullptr);
+  /**
+   * @brief register `isr(arg)` on `pin`, replacing the handler already there
+   * @param isr should be IRAM-safe (`IRAM_ATTR`, touching only IRAM and DRAM),
+   *        as the ISR service is installed with `ESP_INTR_FLAG_IRAM`
+   * @param mode `RISING` or `FALLING` (or a `gpio_int_type_t`)
+   * @param enable false to leave the interrupt masked, e.g. a level one unmasked only when waited for
+   */
+  esp_err_t attachInterruptArg(uint32_t pin, gpio_isr_t isr, void *arg, uint32_t mode, bool enable = true);
+
+  /**
+   * @brief `attachInterruptArg` with a typed argument, e.g.
+   *
+   *       static void IRAM_ATTR on_dio1(radio_ctx_t *ctx);
+   *       hal.attachInterrupt<radio_ctx_t, on_dio1>(pin::DIO1, &ctx, RISING);
+   *
+   * @note `arg` should live as long as the handler is registered
+   */
+  template <typename T, void (*Isr)(T *)>
+  esp_err_t attachInterrupt(uint32_t pin, T *arg, uint32_t mode) {
+    return attachInterruptArg(pin, isrThunk<T, Isr>, arg, mode);
   }
 
   void detachInterrupt(uint32_t interruptNum) override {
@@ -139,27 +290,37 @@ public:
     }
 
     gpio_isr_handler_remove((gpio_num_t)interruptNum);
+    radiolibIsrs[interruptNum] = nullptr;
     gpio_wakeup_disable((gpio_num_t)interruptNum);
     gpio_set_intr_type((gpio_num_t)interruptNum, GPIO_INTR_DISABLE);
   }
 
   void delay(unsigned long ms) override {
-    vTaskDelay(ms / portTICK_PERIOD_MS);
+    // `vTaskDelay(0)` doesn't wait at all, e.g. for the 1 ms the radio takes to enter sleep,
+    // and RadioLib expects at least `ms`
+    delayMicroseconds(ms * 1000);
   }
 
   void delayMicroseconds(unsigned long us) override {
-    uint64_t m = (uint64_t)esp_timer_get_time();
-    if (us) {
-      uint64_t e = (m + us);
-      if (m > e) { // overflow
-        while ((uint64_t)esp_timer_get_time() > e) {
-          NOP();
-        }
-      }
-      while ((uint64_t)esp_timer_get_time() < e) {
+    if (us <= DELAY_SPIN_MAX_US) {
+      const int64_t e = esp_timer_get_time() + us;
+      while (esp_timer_get_time() < e) {
         NOP();
       }
+      return;
     }
+    // a one-shot timer is accurate to tens of microseconds, unlike the tick (10 ms at 100 Hz)
+    if (initDelayTimer()) {
+      // a late give from the last delay
+      xSemaphoreTake(delaySem, 0);
+      if (esp_timer_start_once(delayTimer, us) == ESP_OK) {
+        xSemaphoreTake(delaySem, portMAX_DELAY);
+        return;
+      }
+    }
+    // `vTaskDelay(n)` returns within (n - 1, n] ticks, so one more tick never undershoots
+    const uint32_t tick_us = 1'000'000 / configTICK_RATE_HZ;
+    vTaskDelay((us + tick_us - 1) / tick_us + 1);
   }
 
   unsigned long millis() override {
@@ -199,10 +360,19 @@ public:
         .max_transfer_sz = 32,
     };
 
-    // it might be initialized already
-    auto ret = spi_bus_initialize(SPI_HOST, &bus_cfg, SPI_DMA_CH_AUTO);
-    if (ret != ESP_OK) {
-      ESP_LOGW("spi_bus_initialize", "%s (%d)", esp_err_to_name(ret), ret);
+    auto ret = ESP_OK;
+    // initialized by the first instance, which is counted only once it succeeds
+    if (!busCounted) {
+      if (busUsers == 0) {
+        ret = spi_bus_initialize(SPI_HOST, &bus_cfg, SPI_DMA_CH_AUTO);
+        if (ret != ESP_OK) {
+          ESP_LOGW("spi_bus_initialize", "%s (%d)", esp_err_to_name(ret), ret);
+        }
+      }
+      if (ret == ESP_OK) {
+        busUsers += 1;
+        busCounted = true;
+      }
     }
 
     spi_device_interface_config_t dev_cfg = {
@@ -214,11 +384,16 @@ public:
         .queue_size     = 7};
     ret = spi_bus_add_device(SPI_HOST, &dev_cfg, &spi);
     ESP_ERROR_CHECK(ret);
+    ret = spiLock.init();
+    if (ret != ESP_OK) {
+      ESP_LOGW(TAG, "failed to create pm lock; %s (%d)", esp_err_to_name(ret), ret);
+    }
   }
 
   void spiBeginTransaction() override {
-    // not needed - in ESP32 Arduino core, this function
-    // repeats clock div, mode and bit-order configuration
+    // in ESP32 Arduino core, this function repeats clock div, mode and bit-order configuration,
+    // which is not needed here. RadioLib wraps each command (i.e. a SPI burst) with it.
+    spiLock.acquire();
   }
 
   uint8_t spiTransferByte(uint8_t b) {
@@ -229,11 +404,14 @@ public:
         .rxlength = 8,
     };
     trans.tx_data[0] = b;
-    // acquire finite time not supported now
-    spi_device_acquire_bus(spi, portMAX_DELAY);
+    // already held if CS is low
+    const bool held = busHeld;
+    acquireBus();
     auto ret = spi_device_polling_transmit(spi, &trans);
     ESP_ERROR_CHECK(ret);
-    spi_device_release_bus(spi);
+    if (!held) {
+      releaseBus();
+    }
     return trans.rx_data[0];
   }
 
@@ -247,19 +425,31 @@ public:
         .tx_buffer = out,
         .rx_buffer = in,
     };
-    spi_device_acquire_bus(spi, portMAX_DELAY);
+    // already held if CS is low
+    const bool held = busHeld;
+    acquireBus();
     auto ret = spi_device_polling_transmit(spi, &trans);
     ESP_ERROR_CHECK(ret);
-    spi_device_release_bus(spi);
+    if (!held) {
+      releaseBus();
+    }
   }
 
   void spiEndTransaction() override {
-    // nothing needs to be done here
+    spiLock.release();
   }
 
   void spiEnd() override {
+    releaseBus();
     spi_bus_remove_device(spi);
-    spi_bus_free(SPI_HOST);
+    spi = nullptr;
+    // freed by the last instance
+    if (busCounted) {
+      busCounted = false;
+      if (--busUsers == 0) {
+        spi_bus_free(SPI_HOST);
+      }
+    }
   }
 
   void yield() override {
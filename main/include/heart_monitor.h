@@ -15,6 +15,8 @@ struct HeartMonitor {
   std::string name;
   addr_t addr{0};
   NimBLEClient *client             = nullptr;
+  /// in dBm, from the scan result and then the connection. 0 if not known.
+  int8_t rssi                      = 0;
   // I'm not sure if the callback would be deleted when the client is deleted
   // It should be...
   NimBLEClientCallbacks *callbacks = nullptr;
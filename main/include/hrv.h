@@ -0,0 +1,152 @@
+#ifndef BLE_LORA_ADAPTER_HRV_H
+#define BLE_LORA_ADAPTER_HRV_H
+
+#include <array>
+#include <cstdint>
+#include <cnl/all.h>
+#include <etl/optional.h>
+#include "hr_lora.h"
+#include "common.h"
+
+namespace hrv {
+/**
+ * @brief an RR interval (or a statistic of them) in seconds
+ * @note the same resolution as the Heart Rate Measurement characteristic (1/1024 s),
+ *       so a raw RR interval is taken as is.
+ */
+using rr_t = cnl::scaled_integer<int32_t, cnl::power<-10>>;
+/**
+ * @brief the square of `rr_t`, in seconds squared
+ */
+using rr_sq_t = cnl::scaled_integer<int64_t, cnl::power<-20>>;
+
+/**
+ * @param raw in 1/1024 s, as in the Heart Rate Measurement characteristic
+ */
+constexpr rr_t from_raw(uint16_t raw) {
+  return cnl::from_rep<rr_t, int32_t>{}(raw);
+}
+
+/**
+ * @return rounded to milliseconds, saturated at `UINT16_MAX`
+ */
+constexpr uint16_t to_ms(rr_t rr) {
+  const int64_t ms = (static_cast<int64_t>(cnl::to_rep(rr)) * 1000 + 512) >> 10;
+  return ms < 0 ? 0 : (ms > UINT16_MAX ? UINT16_MAX : static_cast<uint16_t>(ms));
+}
+
+struct config_t {
+  /// the number of the successive differences for RMSSD
+  uint16_t rmssd_window = common::HRV_RMSSD_WINDOW;
+  /// the number of the RR intervals for SDNN
+  uint16_t sdnn_window  = common::HRV_SDNN_WINDOW;
+  /// an RR interval out of [min_rr, max_rr] is an artifact (i.e. 200 ~ 30 bpm)
+  rr_t min_rr           = from_raw(307);
+  rr_t max_rr           = from_raw(2048);
+  /// an RR interval differing from the last accepted one by more than this percentage is an artifact
+  uint8_t max_change    = 20;
+  /// accept anyway after this many artifacts in a row, as the rhythm itself has changed
+  uint8_t max_rejected  = 3;
+};
+
+struct summary_t {
+  rr_t rmssd;
+  rr_t sdnn;
+  rr_t mean;
+  /// the number of the RR intervals used for `sdnn`
+  uint16_t beats;
+};
+
+/**
+ * @brief reject the artifacts in the RR intervals and keep rolling RMSSD and SDNN
+ * @note integer (fixed-point) arithmetic only. The sums are updated incrementally
+ *       (and exactly) for each beat, so `summary` doesn't walk the windows.
+ * @note not thread safe. `feed` is expected to be called from the BLE callback only.
+ */
+class Analyzer {
+public:
+  static constexpr size_t max_window = common::HRV_MAX_WINDOW;
+
+private:
+  /**
+   * @brief a ring of the reps with the running sum and sum of squares
+   */
+  struct window_t {
+    std::array<int32_t, max_window> values{};
+    size_t head    = 0;
+    size_t size    = 0;
+    int64_t sum    = 0;
+    int64_t sum_sq = 0;
+
+    void push(int32_t v, size_t limit);
+    void clear() {
+      head   = 0;
+      size   = 0;
+      sum    = 0;
+      sum_sq = 0;
+    }
+  };
+
+  config_t config;
+  /// the accepted RR intervals
+  window_t rr{};
+  /// the successive differences of the accepted RR intervals
+  window_t diff{};
+  etl::optional<rr_t> last = etl::nullopt;
+  /// the artifacts since the last accepted RR interval
+  uint8_t rejected_in_row  = 0;
+  size_t _rejected_count   = 0;
+
+  [[nodiscard]] bool is_artifact(rr_t v) const;
+
+public:
+  explicit Analyzer(config_t config = {});
+
+  /**
+   * @param rr an RR interval, in the order of arrival
+   * @return false if it's rejected as an artifact
+   */
+  bool feed(rr_t rr);
+
+  /**
+   * @brief feed the RR intervals (if any) in a Heart Rate Measurement notification
+   * @return the number of the RR intervals read
+   */
+  size_t feed_measurement(const uint8_t *data, size_t size);
+
+  /**
+   * @return nullopt if there are not enough beats (i.e. less than 3)
+   */
+  [[nodiscard]] etl::optional<summary_t> summary() const;
+
+  void reset();
+
+  /**
+   * @return the number of the RR intervals rejected since the start (or `reset`)
+   */
+  [[nodiscard]] size_t rejected_count() const {
+    return _rejected_count;
+  }
+};
+
+/**
+ * @brief take a `HrLoRa::hrv_summary` from an `Analyzer` every `interval`
+ */
+class Reporter {
+  std::chrono::milliseconds interval;
+  etl::optional<int64_t> last_us = etl::nullopt;
+  uint8_t seq                    = 0;
+  size_t rejected_before         = 0;
+
+public:
+  explicit Reporter(std::chrono::milliseconds interval = common::HRV_SUMMARY_INTERVAL) : interval(interval) {}
+
+  /**
+   * @param now_us `esp_timer_get_time`
+   * @return the summary if it's due and there are enough beats
+   */
+  etl::optional<HrLoRa::hrv_summary::t> poll(const Analyzer &analyzer, HrLoRa::name_map_key_t key, int64_t now_us);
+};
+}
+
+#endif // BLE_LORA_ADAPTER_HRV_H
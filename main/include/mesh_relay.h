@@ -0,0 +1,94 @@
+#ifndef BLE_LORA_ADAPTER_MESH_RELAY_H
+#define BLE_LORA_ADAPTER_MESH_RELAY_H
+
+#include <functional>
+#include <etl/array.h>
+#include <esp_timer.h>
+#include <esp_check.h>
+#include "hr_lora.h"
+#include "common.h"
+
+namespace mesh {
+/**
+ * @brief forward the uplink frames overheard from distant repeaters to the hub
+ * @note each overheard frame is delayed randomly before relaying. If the same frame
+ *       is heard again (i.e. relayed by someone else) in the meantime, the pending
+ *       relay is cancelled. The total airtime spent on relaying is capped by
+ *       `common::RELAY_AIRTIME_BUDGET` per `common::RELAY_AIRTIME_WINDOW`, which is reserved
+ *       when a relay is queued and given back when it's cancelled.
+ * @note a due relay is sent in the TDMA slot of this repeater (if synchronized), like
+ *       its own frames, so that it never collides with the slot owners.
+ * @note not thread safe. `on_overheard` and `pop_due` are expected to be called
+ *       from the same (parser) task.
+ */
+class Relay {
+  static constexpr auto TAG = "relay";
+  struct pending_t {
+    uint8_t buf[HrLoRa::relay::max_payload_size + 2]{};
+    size_t size                = 0;
+    int64_t due_us             = 0;
+    HrLoRa::name_map_key_t key = 0;
+    uint16_t tag               = 0;
+    /// reserved from the budget of the window starting at `window_start_us`
+    int64_t airtime_us         = 0;
+    int64_t window_start_us    = 0;
+    bool active                = false;
+  };
+  HrLoRa::dedupe_cache<common::RELAY_CACHE_SIZE> cache{};
+  etl::array<pending_t, common::RELAY_QUEUE_SIZE> pending{};
+  esp_timer_handle_t timer = nullptr;
+  int64_t window_start_us  = 0;
+  int64_t airtime_used_us  = 0;
+  size_t _relayed_count    = 0;
+  size_t _suppressed_count = 0;
+
+  /**
+   * @brief arm the timer for the earliest pending relay
+   */
+  void rearm();
+
+  static void timer_cb(void *arg);
+
+public:
+  /**
+   * @brief called from the `esp_timer` task when a relay is due.
+   * @note should not block. Notify the parser task to call `pop_due` instead.
+   */
+  std::function<void()> on_due = nullptr;
+  /**
+   * @brief estimate the airtime in microseconds of a frame with the given length
+   * @sa PhysicalLayer::getTimeOnAir
+   */
+  std::function<uint32_t(size_t)> time_on_air = nullptr;
+
+  Relay() = default;
+
+  esp_err_t init();
+
+  /**
+   * @brief feed a frame received from another repeater (either direct or relayed)
+   * @param own_key the key of this repeater, whose own frames are never relayed again
+   */
+  void on_overheard(const uint8_t *data, size_t size, HrLoRa::name_map_key_t own_key);
+
+  /**
+   * @brief take a due relay frame
+   * @param [out] buffer the buffer to hold the frame
+   * @return the size of the frame, 0 if nothing is due
+   */
+  size_t pop_due(uint8_t *buffer, size_t size);
+
+  [[nodiscard]] size_t relayed_count() const {
+    return _relayed_count;
+  }
+
+  /**
+   * @return the number of frames not relayed because of duplication, airtime budget or full queue
+   */
+  [[nodiscard]] size_t suppressed_count() const {
+    return _suppressed_count;
+  }
+};
+}
+
+#endif // BLE_LORA_ADAPTER_MESH_RELAY_H
@@ -0,0 +1,119 @@
+#ifndef BLE_LORA_ADAPTER_POWER_H
+#define BLE_LORA_ADAPTER_POWER_H
+
+#include <sdkconfig.h>
+#include <esp_attr.h>
+#include <esp_err.h>
+#include <esp_pm.h>
+#include <driver/gpio.h>
+
+namespace power {
+#if CONFIG_PM_ENABLE
+/// whether `enable_wakeup` turns the interrupt into a level one, which `mask` and `rearm` deal with
+inline constexpr bool level_wakeup = true;
+#else
+inline constexpr bool level_wakeup = false;
+#endif
+
+/**
+ * @brief the dynamic frequency scaling (DFS) and the automatic light sleep of `esp_pm`
+ */
+struct config_t {
+  int max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+  /// the CPU runs at this frequency unless a `ESP_PM_CPU_FREQ_MAX` lock is held
+  int min_freq_mhz = CONFIG_XTAL_FREQ;
+  /// enter light sleep when every task is blocked, woken by the timers, BLE and `enable_wakeup`
+  bool light_sleep = true;
+};
+
+/**
+ * @brief an `esp_pm` lock, which does nothing before `init` or without `CONFIG_PM_ENABLE`
+ * @note the lock is counted, i.e. could be acquired again by the holder
+ */
+class Lock {
+  esp_pm_lock_type_t type;
+  const char *name;
+  esp_pm_lock_handle_t handle = nullptr;
+
+public:
+  constexpr Lock(esp_pm_lock_type_t type, const char *name) : type(type), name(name) {}
+
+  Lock(const Lock &)            = delete;
+  Lock &operator=(const Lock &) = delete;
+
+  esp_err_t init();
+
+  void acquire() {
+    if (handle != nullptr) {
+      esp_pm_lock_acquire(handle);
+    }
+  }
+
+  void release() {
+    if (handle != nullptr) {
+      esp_pm_lock_release(handle);
+    }
+  }
+};
+
+/**
+ * @brief hold a `Lock` in a scope
+ */
+class LockGuard {
+  Lock &lock;
+
+public:
+  explicit LockGuard(Lock &lock) : lock(lock) {
+    lock.acquire();
+  }
+
+  ~LockGuard() {
+    lock.release();
+  }
+
+  LockGuard(const LockGuard &)            = delete;
+  LockGuard &operator=(const LockGuard &) = delete;
+};
+
+/// the max frequency while the radio transmits (and scans the channel),
+/// so that RadioLib's polling of DIO1 and the TX timing are not slowed down
+extern Lock radio_tx;
+/// the max frequency while handling a notification of the heart rate monitor (i.e. a BLE connection event)
+extern Lock ble_event;
+
+/**
+ * @brief configure `esp_pm` and create the locks above
+ * @note does nothing without `CONFIG_PM_ENABLE`, i.e. the CPU stays at `CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ`
+ */
+esp_err_t init(const config_t &config = {});
+
+/**
+ * @brief wake up from light sleep when `pin` goes high (e.g. DIO1 of the radio)
+ * @note light sleep only supports the level wakeup of a GPIO, which also turns the interrupt
+ *       of `pin` into a high level one. The ISR should `mask` it, and the task `rearm` it
+ *       once the source (e.g. the radio IRQ) is cleared, or the ISR keeps firing.
+ * @note does nothing without `CONFIG_PM_ENABLE`, and the interrupt keeps its type
+ */
+esp_err_t enable_wakeup(gpio_num_t pin);
+
+/**
+ * @brief mask the interrupt of a wakeup pin. Called from its ISR.
+ * @note IRAM-safe with `CONFIG_GPIO_CTRL_FUNC_IN_IRAM`, as it's always inlined into the ISR
+ */
+FORCE_INLINE_ATTR void mask(gpio_num_t pin) {
+  if constexpr (level_wakeup) {
+    gpio_intr_disable(pin);
+  }
+}
+
+/**
+ * @brief unmask the interrupt of a wakeup pin masked by `mask`
+ */
+inline void rearm(gpio_num_t pin) {
+  if constexpr (level_wakeup) {
+    gpio_intr_enable(pin);
+  }
+}
+}
+
+#endif // BLE_LORA_ADAPTER_POWER_H
@@ -0,0 +1,130 @@
+#ifndef BLE_LORA_ADAPTER_RADIO_METRICS_H
+#define BLE_LORA_ADAPTER_RADIO_METRICS_H
+
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <freertos/FreeRTOS.h>
+#include <RadioLib.h>
+#include <etl/optional.h>
+#include "hr_lora.h"
+#include "trace.h"
+
+namespace radio {
+/**
+ * @brief the link quality of a received packet
+ */
+struct link_sample_t {
+  int8_t rssi_dbm       = 0;
+  /// in 0.25 dB
+  int8_t snr_qdb        = 0;
+  int16_t freq_error_hz = 0;
+};
+
+/**
+ * @brief the IRQ flags of the last packet, if the driver exposes them
+ * @note must be read before `readData`, which clears them
+ */
+template <typename Radio>
+etl::optional<uint16_t> irq_status(Radio &rf) {
+  if constexpr (requires { rf.getIrqStatus(); }) {
+    return static_cast<uint16_t>(rf.getIrqStatus());
+  } else {
+    return etl::nullopt;
+  }
+}
+
+/// the IRQ flags of a received (or failed) packet, unlike TX done or CAD done, which also fire DIO1
+constexpr uint16_t rx_irq_flags = RADIOLIB_SX126X_IRQ_RX_DONE | RADIOLIB_SX126X_IRQ_CRC_ERR |
+                                  RADIOLIB_SX126X_IRQ_HEADER_ERR | RADIOLIB_SX126X_IRQ_TIMEOUT;
+
+/**
+ * @brief clear only `flags` of the IRQ status, if the driver exposes it
+ */
+template <typename Radio>
+void clear_irq(Radio &rf, uint16_t flags) {
+  if constexpr (requires { rf.clearIrqStatus(flags); }) {
+    rf.clearIrqStatus(flags);
+  }
+}
+
+/**
+ * @brief the link quality of the last received packet
+ */
+template <typename Radio>
+link_sample_t link_sample(Radio &rf) {
+  link_sample_t s;
+  s.rssi_dbm = static_cast<int8_t>(std::clamp<float>(rf.getRSSI(), INT8_MIN, INT8_MAX));
+  s.snr_qdb  = static_cast<int8_t>(std::clamp<float>(rf.getSNR() * 4, INT8_MIN, INT8_MAX));
+  // not every version of the driver could estimate it for SX126x
+  if constexpr (requires { rf.getFrequencyError(); }) {
+    s.freq_error_hz = static_cast<int16_t>(std::clamp<float>(rf.getFrequencyError(), INT16_MIN, INT16_MAX));
+  }
+  return s;
+}
+
+/**
+ * @brief the counters of the radio and the link quality of the recently received packets
+ * @note `on_*` are called from the radio task, and `snapshot` from any task.
+ *       Guarded by `lock`, which is only held to copy a few words.
+ */
+class Metrics {
+public:
+  static constexpr size_t window_size = HrLoRa::diagnostics_response::window_size;
+
+private:
+  using window_t = std::array<link_sample_t, window_size>;
+  window_t window{};
+  /// the number of the valid samples in `window`
+  size_t filled = 0;
+  /// where the next sample goes
+  size_t head   = 0;
+  HrLoRa::diagnostics_response::t counters{};
+  mutable portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+  /**
+   * @return the number of the valid samples copied into `out`
+   */
+  size_t copy_window(window_t &out) const;
+
+public:
+  /// the time spent in `transmit` (i.e. time on air plus the SPI traffic)
+  trace::Histogram tx_time{"tx_time"};
+
+  /**
+   * @brief a packet is received without an error
+   */
+  void on_rx(const link_sample_t &sample);
+
+  /**
+   * @param irq see `irq_status`. Counted as a CRC error if not available.
+   */
+  void on_rx_error(etl::optional<uint16_t> irq);
+
+  /**
+   * @param elapsed_us the time spent in `transmit`
+   * @param timeout whether the TX_DONE IRQ never came
+   */
+  void on_tx_done(int64_t elapsed_us, bool timeout);
+
+  /**
+   * @return the counters and the link quality of the window. `short_addr`, `key`
+   *         and `rx_dropped` are left for the caller.
+   */
+  [[nodiscard]] HrLoRa::diagnostics_response::t snapshot() const;
+
+  /**
+   * @return the mean of the window, nullopt if nothing is received yet
+   */
+  [[nodiscard]] etl::optional<link_sample_t> average() const;
+
+  /**
+   * @brief log the counters and the link quality
+   */
+  void dump() const;
+};
+
+extern Metrics metrics;
+}
+
+#endif // BLE_LORA_ADAPTER_RADIO_METRICS_H
@@ -0,0 +1,249 @@
+#ifndef BLE_LORA_ADAPTER_RADIO_PROFILE_H
+#define BLE_LORA_ADAPTER_RADIO_PROFILE_H
+
+#include <RadioLib.h>
+#include "hr_lora.h"
+
+namespace radio {
+/**
+ * @brief how a repeater listens for the downlink (i.e. the frames from the hub)
+ */
+enum class rx_mode_t : uint8_t {
+  /// always receiving, except when transmitting
+  continuous,
+  /**
+   * @brief only after an uplink and around the expected beacons, and sleeping otherwise
+   * @note the hub should hold a command for a repeater until one of its windows.
+   * @sa tdma::RxWindows
+   */
+  windowed,
+  /**
+   * @brief the hardware RX duty cycle of SX126x, i.e. sleeping and listening for a preamble in turn
+   * @note reachable at any time, as long as the hub sends every frame (including the beacons)
+   *       with `profile_t::wake_preamble_len`
+   * @sa sniff_estimate
+   */
+  duty_cycle,
+};
+
+/**
+ * @brief the radio parameters shared by the hub and all the repeaters.
+ * @note the hub and the repeaters MUST use the same profile, which is how
+ *       the header mode of the telemetry frames is negotiated.
+ */
+struct profile_t {
+  float freq_mhz        = 434;
+  float bw_khz          = 500.0;
+  uint8_t sf            = 7;
+  uint8_t cr            = 7;
+  uint8_t sync_word     = RADIOLIB_SX126X_SYNC_WORD_PRIVATE;
+  int8_t power_dbm      = 22;
+  uint16_t preamble_len = 8;
+  float tcxo_voltage    = 1.6;
+  /**
+   * @brief send the fixed-size telemetry frames (i.e. `hr_data`) in implicit header mode
+   * @note the variable-length control traffic (e.g. `query_device_by_mac_response`)
+   *       always uses explicit header. The telemetry frames are sent with `hr_data_sync_word`
+   *       so that a receiver listening for control traffic (explicit header) would not try to
+   *       decode them. The hub is expected to listen with `hr_data_sync_word` in implicit
+   *       header mode during the TDMA slots, and with `sync_word` in explicit header mode otherwise.
+   * @note the repeaters always listen in explicit header mode with `sync_word`, so they never
+   *       overhear the telemetry frames of each other. Which turns off the mesh relay (rejected at
+   *       compile time), the overheard sequence counters, and the TDMA slot conflict detection
+   *       except on the frames sent in explicit header (e.g. `hrv_summary`, `hr_aggregate`).
+   */
+  bool implicit_hr_data     = false;
+  uint8_t hr_data_sync_word = RADIOLIB_SX126X_SYNC_WORD_PRIVATE;
+  /**
+   * @brief the telemetry frame format
+   * @note 1 for `hr_data`; 2 for `hr_data_v2`, which carries a sequence number and CRC;
+   *       3 for `hr_data_redundant`, which also carries `hr_data_history` previous samples
+   */
+  uint8_t hr_data_version = 1;
+  /**
+   * @brief the number of the previous samples carried by each `hr_data_redundant`
+   * @note the hub could recover up to this many consecutive lost frames, at the cost of
+   *       one byte per sample in every frame
+   * @sa HrLoRa::hr_data_redundant::max_history
+   */
+  uint8_t hr_data_history = 0;
+  /**
+   * @brief tag every `hr_data_v2` with `HrLoRa::hr_data_v2::link_t`, for the hub to pick the best
+   *        repeater of a heart rate monitor heard by several of them (see `HrLoRa::path_selector`)
+   * @note only used by version 2. Two more bytes per frame.
+   */
+  bool hr_data_link     = false;
+  rx_mode_t rx_mode     = rx_mode_t::continuous;
+  /// `rx_mode_t::windowed`: how long a window stays open after an uplink, or after the beacon
+  uint16_t rx_window_ms = 0;
+  /// `rx_mode_t::windowed`: how early a beacon window opens, which covers the airtime of the beacon and the clock drift
+  uint16_t rx_guard_ms  = 0;
+  /**
+   * @brief `rx_mode_t::duty_cycle`: the preamble (in symbols) of every frame from the hub
+   * @note the repeater only sleeps for about `wake_preamble_len - 2 * sniff_min_symbols` symbols at a time,
+   *       so a longer preamble saves more power at the cost of the airtime (i.e. latency) of every downlink.
+   *       The uplink still uses `preamble_len`, since the hub is always receiving.
+   */
+  uint16_t wake_preamble_len = 0;
+  /// `rx_mode_t::duty_cycle`: the preamble symbols to catch before going back to sleep
+  uint8_t sniff_min_symbols  = 8;
+};
+
+/**
+ * @brief the profile compatible with the hub before the implicit header mode is introduced
+ */
+constexpr auto legacy_profile = profile_t{};
+
+/**
+ * @brief save the explicit header (about 20 symbols with CR 4/7) on every `hr_data` frame
+ */
+constexpr auto implicit_hr_profile = profile_t{
+    .implicit_hr_data  = true,
+    .hr_data_sync_word = 0x21,
+    .hr_data_version   = 2,
+};
+
+/**
+ * @brief `implicit_hr_profile` with the last 3 samples in every frame
+ */
+constexpr auto redundant_hr_profile = profile_t{
+    .implicit_hr_data  = true,
+    .hr_data_sync_word = 0x21,
+    .hr_data_version   = 3,
+    .hr_data_history   = 3,
+};
+static_assert(redundant_hr_profile.hr_data_history <= HrLoRa::hr_data_redundant::max_history);
+
+/**
+ * @brief `implicit_hr_profile` with the radio sleeping between the receive windows,
+ *        for the battery powered repeaters
+ * @note a command reaches a synchronized repeater within one superframe plus `rx_window_ms`,
+ *       as the hub could send it right after the next beacon.
+ */
+constexpr auto windowed_rx_profile = profile_t{
+    .implicit_hr_data  = true,
+    .hr_data_sync_word = 0x21,
+    .hr_data_version   = 2,
+    .rx_mode           = rx_mode_t::windowed,
+    .rx_window_ms      = 150,
+    .rx_guard_ms       = 20,
+};
+
+/**
+ * @brief `implicit_hr_profile` with the link quality in every frame, for roaming between repeaters
+ */
+constexpr auto link_tagged_hr_profile = profile_t{
+    .implicit_hr_data  = true,
+    .hr_data_sync_word = 0x21,
+    .hr_data_version   = 2,
+    .hr_data_link      = true,
+};
+
+/**
+ * @brief `implicit_hr_profile` with the receiver in the RX duty cycle
+ * @note with SF7 and 500 kHz (256 us per symbol), the downlink spends about 129 ms more on the
+ *       preamble, and the receiver listens about 2% of the time (about 95 uA instead of 4.6 mA).
+ *       See `sniff_estimate`.
+ */
+constexpr auto sniff_rx_profile = profile_t{
+    .implicit_hr_data  = true,
+    .hr_data_sync_word = 0x21,
+    .hr_data_version   = 2,
+    .rx_mode           = rx_mode_t::duty_cycle,
+    .wake_preamble_len = 512,
+    .sniff_min_symbols = 8,
+};
+
+inline constexpr auto &active_profile = legacy_profile;
+
+/**
+ * @brief the cost of `rx_mode_t::duty_cycle` compared to the continuous receive
+ * @note a model of the periods chosen by `startReceiveDutyCycleAuto` of RadioLib.
+ *       The currents are the typical ones in the LLCC68 datasheet (DC-DC, RX boost off).
+ */
+struct sniff_estimate_t {
+  uint32_t symbol_us        = 0;
+  /// the listening period of each cycle
+  uint32_t listen_us        = 0;
+  /// the sleeping period of each cycle; 0 if the radio would never sleep (i.e. continuous receive)
+  uint32_t sleep_us         = 0;
+  /// the extra airtime of every downlink frame, for the longer preamble
+  uint32_t extra_latency_us = 0;
+  /// the average current of the receiver
+  uint32_t avg_current_ua   = 0;
+
+  static constexpr uint32_t rx_current_ua    = 4'600;
+  static constexpr uint32_t sleep_current_ua = 1;
+};
+
+constexpr sniff_estimate_t sniff_estimate(const profile_t &profile) {
+  auto e             = sniff_estimate_t{};
+  e.symbol_us        = static_cast<uint32_t>((1000.0f * (1u << profile.sf)) / profile.bw_khz);
+  const uint32_t pre = profile.wake_preamble_len;
+  const uint32_t min = profile.sniff_min_symbols;
+  if (profile.rx_mode != rx_mode_t::duty_cycle || 2 * min > pre) {
+    e.listen_us      = e.symbol_us;
+    e.avg_current_ua = sniff_estimate_t::rx_current_ua;
+    return e;
+  }
+  e.sleep_us         = e.symbol_us * (pre - 2 * min);
+  const uint32_t a   = (e.symbol_us * (pre + 1) - (e.sleep_us - 1000)) / 2;
+  const uint32_t b   = e.symbol_us * (min + 1);
+  e.listen_us        = a > b ? a : b;
+  e.extra_latency_us = pre > profile.preamble_len ? e.symbol_us * (pre - profile.preamble_len) : 0;
+  e.avg_current_ua   = static_cast<uint32_t>((static_cast<uint64_t>(e.listen_us) * sniff_estimate_t::rx_current_ua +
+                                            static_cast<uint64_t>(e.sleep_us) * sniff_estimate_t::sleep_current_ua) /
+                                           (e.listen_us + e.sleep_us));
+  return e;
+}
+
+/**
+ * @brief start receiving in the way of `profile.rx_mode`
+ * @note the continuous receive stays in RX after a packet, while the RX duty cycle
+ *       goes to standby and has to be started again
+ */
+inline int16_t start_receive(LLCC68 &rf, const profile_t &profile) {
+  if (profile.rx_mode == rx_mode_t::duty_cycle) {
+    return rf.startReceiveDutyCycleAuto(profile.wake_preamble_len, profile.sniff_min_symbols);
+  }
+  return rf.startReceive();
+}
+
+inline int16_t begin(LLCC68 &rf, const profile_t &profile) {
+  return rf.begin(profile.freq_mhz, profile.bw_khz, profile.sf, profile.cr,
+                  profile.sync_word, profile.power_dbm, profile.preamble_len, profile.tcxo_voltage);
+}
+
+/**
+ * @brief switch to the packet format of the fixed-size telemetry frames
+ * @param len the length of the telemetry frame, which is required by the implicit header mode
+ * @note no-op if the profile doesn't enable implicit header
+ */
+inline int16_t telemetry_mode(LLCC68 &rf, const profile_t &profile, size_t len) {
+  if (!profile.implicit_hr_data) {
+    return RADIOLIB_ERR_NONE;
+  }
+  auto err = rf.implicitHeader(len);
+  if (err != RADIOLIB_ERR_NONE) {
+    return err;
+  }
+  return rf.setSyncWord(profile.hr_data_sync_word);
+}
+
+/**
+ * @brief switch back to the packet format of the control traffic
+ * @note no-op if the profile doesn't enable implicit header
+ */
+inline int16_t control_mode(LLCC68 &rf, const profile_t &profile) {
+  if (!profile.implicit_hr_data) {
+    return RADIOLIB_ERR_NONE;
+  }
+  auto err = rf.explicitHeader();
+  if (err != RADIOLIB_ERR_NONE) {
+    return err;
+  }
+  return rf.setSyncWord(profile.sync_word);
+}
+}
+
+#endif // BLE_LORA_ADAPTER_RADIO_PROFILE_H
@@ -0,0 +1,98 @@
+#ifndef BLE_LORA_ADAPTER_RX_POOL_H
+#define BLE_LORA_ADAPTER_RX_POOL_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <etl/queue_spsc_atomic.h>
+
+namespace rx {
+/**
+ * @brief a received LoRa packet
+ */
+struct buffer_t {
+  /// the largest LoRa payload
+  uint8_t data[255]{};
+  size_t size        = 0;
+  /// the time of the DIO1 interrupt (`esp_timer_get_time`)
+  int64_t rx_time_us = 0;
+};
+
+/**
+ * @brief a fixed pool of `buffer_t` handed from the radio task to the parser task by pointer
+ * @note two lock-free SPSC queues: the radio task is the only one calling `acquire` and
+ *       `submit`, and the parser task is the only one calling `take` and `release`.
+ */
+template <size_t N>
+class Pool {
+  std::array<buffer_t, N> buffers{};
+  /// released by the parser, acquired by the radio
+  etl::queue_spsc_atomic<buffer_t *, N> free_q{};
+  /// submitted by the radio, taken by the parser
+  etl::queue_spsc_atomic<buffer_t *, N> ready_q{};
+  std::atomic<size_t> _dropped_count{0};
+
+public:
+  Pool() {
+    for (auto &b : buffers) {
+      free_q.push(&b);
+    }
+  }
+
+  Pool(const Pool &)            = delete;
+  Pool &operator=(const Pool &) = delete;
+
+  /**
+   * @return nullptr if all the buffers are in use. The packet should be dropped.
+   */
+  buffer_t *acquire() {
+    buffer_t *b = nullptr;
+    if (!free_q.pop(b)) {
+      _dropped_count += 1;
+      return nullptr;
+    }
+    return b;
+  }
+
+  /**
+   * @brief hand an acquired buffer to the parser
+   */
+  void submit(buffer_t *b) {
+    ready_q.push(b);
+  }
+
+  /**
+   * @brief give an acquired buffer back without submitting it (e.g. failed to read)
+   * @note called from the radio task. Only valid before the buffer is submitted.
+   */
+  void discard(buffer_t *b) {
+    // the free queue is pushed by the parser side; hand it over as an empty packet instead
+    b->size = 0;
+    ready_q.push(b);
+  }
+
+  /**
+   * @return nullptr if nothing is submitted
+   */
+  buffer_t *take() {
+    buffer_t *b = nullptr;
+    if (!ready_q.pop(b)) {
+      return nullptr;
+    }
+    return b;
+  }
+
+  void release(buffer_t *b) {
+    free_q.push(b);
+  }
+
+  /**
+   * @return the number of the packets dropped as the pool is exhausted
+   */
+  [[nodiscard]] size_t dropped_count() const {
+    return _dropped_count;
+  }
+};
+}
+
+#endif // BLE_LORA_ADAPTER_RX_POOL_H
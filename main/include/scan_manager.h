@@ -16,6 +16,8 @@
 #include "utils.h"
 #include "common.h"
 #include "app_nvs.h"
+#include "power.h"
+#include "trace.h"
 
 namespace blue {
 const int MAX_DEVICE_NUM  = 12;
@@ -116,6 +118,14 @@ public:
     }
   }
 
+  /**
+   * @brief borrow the connected device without copying it
+   * @note the pointer is invalidated when the device disconnects
+   */
+  [[nodiscard]] const HeartMonitor *peek_device() const {
+    return device.get();
+  }
+
   [[nodiscard]] etl::optional<white_list::Addr> get_target_addr() const {
     if (target_addr == nullptr) {
       return etl::nullopt;
@@ -209,11 +219,12 @@ private:
     auto nimble_address = advertisedDevice->getAddress();
     auto addr_native    = nimble_address.getNative();
     auto addr           = addr_t{};
+    auto rssi           = static_cast<int8_t>(advertisedDevice->getRSSI());
     std::copy(addr_native, addr_native + HeartMonitor::ADDR_SIZE, addr.begin());
     ESP_LOGI(TAG, "try to connect to %s (%s)", name.c_str(), nimble_address.toString().c_str());
     // for some reason the connection would block the scan callback for a long time
     // I have to create a new thread to do the connection
-    auto connect_task = [name, addr, nimble_address, &self]() {
+    auto connect_task = [name, addr, rssi, nimble_address, &self]() {
       const auto TAG        = "connect";
       NimBLEClient *pClient = nullptr;
       if (self.device != nullptr) {
@@ -229,6 +240,7 @@ private:
                         .name      = name,
                         .addr      = addr,
                         .client    = pClient,
+                        .rssi      = rssi,
                         .callbacks = pClientCallback,
         };
         pClient->setClientCallbacks(pClientCallback);
@@ -263,9 +275,12 @@ private:
                             uint8_t *pData, size_t length, bool isNotify) {
         const auto TAG = "notify";
         if (self.on_data != nullptr) {
+          auto pm          = power::LockGuard(power::ble_event);
+          const auto start = esp_timer_get_time();
           // I'm thinking create a new thread to avoid blocking the callback
           // not sure if it's necessary
           self.on_data(*self.device, pData, length);
+          trace::ble_notify.record(esp_timer_get_time() - start);
         }
       };
       auto ok = pChar->subscribe(true, notify);
@@ -0,0 +1,170 @@
+#ifndef BLE_LORA_ADAPTER_TDMA_H
+#define BLE_LORA_ADAPTER_TDMA_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <esp_timer.h>
+#include <esp_check.h>
+#include <freertos/FreeRTOS.h>
+#include "hr_lora.h"
+
+namespace tdma {
+/**
+ * @brief keeps track of the TDMA superframe announced by the hub beacon
+ *        and fires `on_slot` at the beginning of the slot of this repeater.
+ * @note the slot timer is an `esp_timer` instead of the FreeRTOS tick,
+ *       which is only 100 Hz and too coarse for a slot of a few milliseconds.
+ * @sa HrLoRa::beacon
+ */
+class Scheduler {
+  static constexpr auto TAG = "tdma";
+  esp_timer_handle_t timer  = nullptr;
+  mutable portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+  HrLoRa::beacon::t _beacon{};
+  /**
+   * @brief absolute time (`esp_timer_get_time`) of the next slot of this repeater
+   */
+  int64_t next_slot_us = 0;
+  /**
+   * @brief absolute time of the slot `on_slot` is last called for
+   */
+  int64_t last_slot_us = 0;
+  /**
+   * @brief number of superframes since the last received beacon
+   */
+  size_t missed   = 0;
+  bool _is_synced = false;
+  /**
+   * @brief number of frames overheard from other repeaters sharing the slot of this repeater
+   */
+  size_t _conflict_count = 0;
+
+  static void timer_cb(void *arg);
+
+public:
+  /**
+   * @brief called from the `esp_timer` task at the beginning of the slot.
+   * @note should not block. Notify the radio task instead of transmitting here.
+   */
+  std::function<void()> on_slot = nullptr;
+
+  Scheduler() = default;
+
+  esp_err_t init();
+
+  /**
+   * @brief (re)synchronize the superframe with a beacon from the hub
+   * @param beacon the received beacon
+   * @param rx_time_us the time when the beacon is received (`esp_timer_get_time`),
+   *        better sampled in the DIO1 ISR
+   * @param key the name map key of this repeater, which decides the slot
+   */
+  void on_beacon(const HrLoRa::beacon::t &beacon, int64_t rx_time_us, HrLoRa::name_map_key_t key);
+
+  /**
+   * @brief check the key of a frame overheard (directly) from another repeater in a slot
+   * @note the slot is the key modulo the number of slots (see `HrLoRa::beacon::t::slot_of`), so two keys
+   *       could share a slot and collide in every superframe. It's logged for the hub to reassign the
+   *       keys, since neither repeater could tell which one should move.
+   * @return whether the other repeater transmits in the slot of this repeater
+   */
+  bool check_conflict(HrLoRa::name_map_key_t other, HrLoRa::name_map_key_t key);
+
+  [[nodiscard]] size_t conflict_count() const {
+    return _conflict_count;
+  }
+
+  /**
+   * @brief stop the slot timer and fall back to random access
+   */
+  void desync();
+
+  /**
+   * @return when the latest slot began (`esp_timer_get_time`), i.e. when its timer is due
+   */
+  [[nodiscard]] int64_t slot_us() const;
+
+  /**
+   * @return the length of a slot, 0 if not synced yet
+   */
+  [[nodiscard]] int64_t slot_length_us() const;
+
+  /**
+   * @return whether the repeater should wait for its slot (instead of transmitting immediately)
+   */
+  [[nodiscard]] bool is_synced() const {
+    return _is_synced;
+  }
+};
+
+/**
+ * @brief Class-A style receive windows, i.e. the radio only listens for `window` after an uplink
+ *        and around the expected beacons, and sleeps otherwise (`radio::rx_mode_t::windowed`)
+ * @note a beacon window opens `guard` before the expected beacon and closes `window` after it.
+ *       Before the first beacon, or after missing `common::TDMA_MAX_MISSED_BEACONS` in a row,
+ *       the window stays open (i.e. continuous receive) to catch the next beacon.
+ * @note the timers only call `on_change`; the radio task opens or closes the window by `is_open`.
+ */
+class RxWindows {
+  static constexpr auto TAG = "rx_windows";
+  esp_timer_handle_t open_timer  = nullptr;
+  esp_timer_handle_t close_timer = nullptr;
+  portMUX_TYPE lock              = portMUX_INITIALIZER_UNLOCKED;
+  int64_t window_us;
+  int64_t guard_us;
+  int64_t superframe_us = 0;
+  /**
+   * @brief absolute time (`esp_timer_get_time`) of the next beacon window
+   */
+  int64_t next_open_us = 0;
+  /**
+   * @brief number of beacon windows since the last received beacon
+   */
+  size_t missed   = 0;
+  bool _is_synced = false;
+  std::atomic<bool> _is_open{true};
+
+  static void open_cb(void *arg);
+  static void close_cb(void *arg);
+  void set_open(bool open);
+
+public:
+  /**
+   * @brief called when `is_open` changes, from the `esp_timer` task or the caller of the methods below
+   * @note should not block. Notify the radio task instead.
+   */
+  std::function<void()> on_change = nullptr;
+
+  RxWindows(std::chrono::milliseconds window, std::chrono::milliseconds guard)
+      : window_us(window.count() * 1000LL), guard_us(guard.count() * 1000LL) {}
+
+  esp_err_t init();
+
+  /**
+   * @brief (re)synchronize the beacon windows, and keep the current one open for `window`
+   * @param rx_time_us the time when the beacon is received (`esp_timer_get_time`)
+   */
+  void on_beacon(const HrLoRa::beacon::t &beacon, int64_t rx_time_us);
+
+  /**
+   * @brief open a window for `window` right after an uplink
+   * @note no-op if not synchronized, as the window is always open then
+   */
+  void on_uplink();
+
+  /**
+   * @brief stop the timers and keep the window open
+   */
+  void desync();
+
+  /**
+   * @return whether the radio should be receiving
+   */
+  [[nodiscard]] bool is_open() const {
+    return _is_open;
+  }
+};
+}
+
+#endif // BLE_LORA_ADAPTER_TDMA_H
@@ -0,0 +1,257 @@
+#ifndef BLE_LORA_ADAPTER_TELEMETRY_H
+#define BLE_LORA_ADAPTER_TELEMETRY_H
+
+#include <array>
+#include <algorithm>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include "hr_lora.h"
+#include "radio_profile.h"
+#include "common.h"
+
+namespace telemetry {
+/**
+ * @brief encode the heart rate samples into the telemetry frame chosen by the radio profile
+ * @note the sequence number is assigned when a frame is encoded (i.e. right before
+ *       transmission), so a gap seen by the hub is a lost frame instead of a
+ *       sample superseded in the TDMA buffer.
+ */
+class Encoder {
+  const radio::profile_t &profile;
+  std::atomic<uint8_t> seq{0};
+  std::atomic<uint32_t> _encoded_count{0};
+  /**
+   * @brief the samples of the last encoded frames, the newest first
+   * @note only used by `hr_data_redundant`. Guarded by `lock` since `encode` is called
+   *       from both the BLE callback and the radio task.
+   */
+  std::array<etl::optional<uint8_t>, HrLoRa::hr_data_redundant::max_history> history{};
+  /**
+   * @brief carried by `hr_data_v2` if the profile enables `hr_data_link`
+   * @note guarded by `lock`
+   */
+  HrLoRa::hr_data_v2::link_t link{};
+  portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+  size_t encode_redundant(const HrLoRa::hr_data::t &sample, uint8_t *buffer, size_t size);
+
+public:
+  explicit Encoder(const radio::profile_t &profile) : profile(profile) {}
+
+  /**
+   * @return the size of the telemetry frame, which is fixed for a profile
+   */
+  [[nodiscard]] size_t frame_size() const;
+
+  /**
+   * @return the size of the frame, 0 if the buffer is too small
+   */
+  size_t encode(const HrLoRa::hr_data::t &sample, uint8_t *buffer, size_t size);
+
+  /**
+   * @brief update the link quality carried by the following frames
+   * @note could be called from any task
+   */
+  void set_link(const HrLoRa::hr_data_v2::link_t &link);
+
+  [[nodiscard]] uint32_t encoded_count() const {
+    return _encoded_count;
+  }
+};
+
+enum class report_reason_t : uint8_t {
+  suppressed,
+  /// the first sample since the start (or `reset`)
+  first,
+  /// moved beyond the dead-band
+  changed,
+  /// nothing reported for `max_silence`
+  silence,
+  /// crossed `low_threshold` or `high_threshold`
+  threshold,
+};
+
+struct report_config_t {
+  /// the change (bpm) from the last reported sample that is NOT reported
+  uint8_t dead_band                     = common::REPORT_DEAD_BAND;
+  std::chrono::milliseconds max_silence = common::REPORT_MAX_SILENCE;
+  uint8_t low_threshold                 = common::REPORT_LOW_THRESHOLD;
+  uint8_t high_threshold                = common::REPORT_HIGH_THRESHOLD;
+  /// see `AlarmDetector`
+  uint8_t alarm_rearm_band                     = common::ALARM_REARM_BAND;
+  std::chrono::milliseconds alarm_min_interval = common::ALARM_MIN_INTERVAL;
+};
+
+/**
+ * @brief the running min, average and max of the heart rate over a window, for `HrLoRa::hr_aggregate`
+ * @note the window is closed by the first sample after its end, which also opens the next one.
+ * @note not thread safe, except `set_window`. `feed` is expected to be called from the BLE callback only.
+ */
+class Aggregator {
+  /// the window being aggregated, latched by `feed` when it's opened
+  uint16_t window_s = common::AGGREGATE_WINDOW.count();
+  /// the window set by `set_window`, latched into `window_s` when the next window opens
+  std::atomic<uint16_t> next_window_s{common::AGGREGATE_WINDOW.count()};
+  /// `esp_timer_get_time` when the current window is opened
+  etl::optional<int64_t> start_us = etl::nullopt;
+  uint8_t min                     = UINT8_MAX;
+  uint8_t max                     = 0;
+  uint32_t sum                    = 0;
+  uint16_t count                  = 0;
+  uint8_t seq                     = 0;
+
+public:
+  Aggregator() = default;
+
+  /**
+   * @note takes effect from the next window, i.e. the current one is closed and reported
+   *       with the window it's opened with
+   */
+  void set_window(std::chrono::seconds window) {
+    next_window_s = std::clamp<int64_t>(window.count(), 1, UINT16_MAX);
+  }
+
+  /**
+   * @return the window set last, which might not be applied yet
+   */
+  [[nodiscard]] std::chrono::seconds window() const {
+    return std::chrono::seconds(next_window_s.load());
+  }
+
+  /**
+   * @param now_us `esp_timer_get_time`
+   * @return the aggregate of the previous window, if this sample closes it
+   */
+  etl::optional<HrLoRa::hr_aggregate::t> feed(HrLoRa::name_map_key_t key, uint8_t hr, int64_t now_us);
+
+  /**
+   * @brief drop the current window, e.g. when switching the report mode
+   */
+  void reset() {
+    start_us = etl::nullopt;
+    min      = UINT8_MAX;
+    max      = 0;
+    sum      = 0;
+    count    = 0;
+  }
+};
+
+/**
+ * @brief raise a `HrLoRa::hr_alarm` when the heart rate enters another range
+ *        split by `low_threshold` and `high_threshold`
+ * @note an alarm is cleared only `alarm_rearm_band` back within its threshold, and an alarm of
+ *       the same level is raised at most once every `alarm_min_interval`. A held back change
+ *       is raised by the first sample after the interval, if the heart rate is still there.
+ * @note a heart rate of 0 (i.e. the strap has no skin contact) is ignored.
+ * @note not thread safe. `feed` is expected to be called from the BLE callback only.
+ */
+class AlarmDetector {
+  report_config_t config;
+  HrLoRa::hr_alarm::level_t level = HrLoRa::hr_alarm::level_t::normal;
+  uint8_t alarm_id                = 0;
+  /// `esp_timer_get_time` of the last alarm raised, by `level_t`
+  std::array<etl::optional<int64_t>, 3> last_raised_us{};
+  size_t _held_back_count = 0;
+
+public:
+  explicit AlarmDetector(report_config_t config = {}) : config(config) {}
+
+  [[nodiscard]] HrLoRa::hr_alarm::level_t level_of(uint8_t hr) const {
+    if (hr < config.low_threshold) {
+      return HrLoRa::hr_alarm::level_t::low;
+    }
+    if (hr >= config.high_threshold) {
+      return HrLoRa::hr_alarm::level_t::high;
+    }
+    return HrLoRa::hr_alarm::level_t::normal;
+  }
+
+  /**
+   * @param now_us `esp_timer_get_time`
+   * @return the alarm to send if the range is changed
+   * @note starts from `normal`, i.e. the first sample out of the limits raises an alarm
+   */
+  etl::optional<HrLoRa::hr_alarm::t> feed(HrLoRa::name_map_key_t key, uint8_t hr, int64_t now_us);
+
+  /**
+   * @return the changes of the range not raised (yet) because of `alarm_min_interval`
+   */
+  [[nodiscard]] size_t held_back_count() const {
+    return _held_back_count;
+  }
+};
+
+/**
+ * @brief decide whether a heart rate sample from the strap is worth a transmission
+ * @note the strap notifies about once per second, while the heart rate is
+ *       mostly steady. A suppressed sample is simply dropped.
+ * @note not thread safe, except `set_min_interval`. `feed` is expected to be called
+ *       from the BLE callback only.
+ */
+class ReportPolicy {
+  report_config_t config;
+  /// set by the hub with `HrLoRa::load_control`. 0 for no limit.
+  std::atomic<uint32_t> min_interval_ms{0};
+  /// when `min_interval_ms` expires (`esp_timer_get_time`), 0 for never
+  std::atomic<int64_t> min_interval_until_us{0};
+  etl::optional<uint8_t> last_reported = etl::nullopt;
+  /// the last sample fed, reported or not, to detect the threshold crossing
+  etl::optional<uint8_t> last_seen     = etl::nullopt;
+  int64_t last_reported_us             = 0;
+  size_t _sent_count                   = 0;
+  size_t _suppressed_count             = 0;
+  size_t _throttled_count              = 0;
+
+  [[nodiscard]] bool is_throttled(int64_t now_us) const;
+
+public:
+  explicit ReportPolicy(report_config_t config = {}) : config(config) {}
+
+  /**
+   * @param hr the heart rate from the strap
+   * @param now_us `esp_timer_get_time`
+   * @return `report_reason_t::suppressed` if the sample should not be transmitted
+   */
+  report_reason_t feed(uint8_t hr, int64_t now_us);
+
+  /**
+   * @brief limit the rate of the reports other than the first one and the threshold crossings
+   * @param interval the minimum interval between two reports, 0 for no limit
+   * @param until_us when the limit expires (`esp_timer_get_time`), 0 for never
+   * @note could be called from another task
+   */
+  void set_min_interval(std::chrono::milliseconds interval, int64_t until_us) {
+    min_interval_until_us = until_us;
+    min_interval_ms       = interval.count();
+  }
+
+  /**
+   * @brief forget the last reported sample, e.g. when switching to another strap
+   * @note the counters are kept
+   */
+  void reset() {
+    last_reported = etl::nullopt;
+    last_seen     = etl::nullopt;
+  }
+
+  [[nodiscard]] size_t sent_count() const {
+    return _sent_count;
+  }
+
+  /**
+   * @note including the throttled ones
+   */
+  [[nodiscard]] size_t suppressed_count() const {
+    return _suppressed_count;
+  }
+
+  /**
+   * @return the number of the samples suppressed only because of `set_min_interval`
+   */
+  [[nodiscard]] size_t throttled_count() const {
+    return _throttled_count;
+  }
+};
+}
+
+#endif // BLE_LORA_ADAPTER_TELEMETRY_H
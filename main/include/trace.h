@@ -0,0 +1,78 @@
+#ifndef BLE_LORA_ADAPTER_TRACE_H
+#define BLE_LORA_ADAPTER_TRACE_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace trace {
+/**
+ * @brief a latency histogram with power-of-two buckets in microseconds
+ * @note bucket `i` counts the samples in [2^(i-1), 2^i) us; the last one also
+ *       counts everything longer. `record` is lock-free and could be called from any task.
+ */
+class Histogram {
+public:
+  /// the last bucket starts at about 4 seconds
+  static constexpr size_t bucket_count = 24;
+
+private:
+  const char *_name;
+  std::array<std::atomic<uint32_t>, bucket_count> buckets{};
+  std::atomic<uint32_t> _count{0};
+  std::atomic<uint32_t> _max_us{0};
+
+public:
+  explicit Histogram(const char *name) : _name(name) {}
+
+  void record(int64_t us);
+
+  [[nodiscard]] const char *name() const {
+    return _name;
+  }
+
+  [[nodiscard]] uint32_t count() const {
+    return _count;
+  }
+
+  [[nodiscard]] uint32_t max_us() const {
+    return _max_us;
+  }
+
+  /**
+   * @param p in [0, 100]
+   * @return the upper bound of the bucket containing the `p`-th percentile, 0 if empty
+   */
+  [[nodiscard]] uint32_t percentile_us(uint8_t p) const;
+
+  /**
+   * @brief log the non-empty buckets
+   */
+  void dump() const;
+};
+
+/// from a threshold crossing in the BLE callback to the end of the `HrLoRa::hr_alarm` transmission
+extern Histogram alarm_latency;
+
+/**
+ * @brief from an event to the radio task handling it, i.e. the cost of the light sleep and
+ *        the lowered CPU frequency (see `power::init`)
+ * @note the DIO1 ISR only runs once the chip is awake, so `wake_dio1` misses the wakeup itself,
+ *       which `wake_slot` (measured from when the slot timer is due) includes
+ */
+extern Histogram wake_dio1;
+/// from the beginning of the TDMA slot to the radio task handling `SlotEvt`
+extern Histogram wake_slot;
+/// from a frame queued for the radio task (e.g. a response) to its transmission
+extern Histogram wake_tx;
+/// the time spent in the notification callback of the heart rate monitor,
+/// as the BLE host doesn't see when the connection event wakes the chip
+extern Histogram ble_notify;
+
+/**
+ * @brief dump the histograms above
+ */
+void dump_wake_latency();
+}
+
+#endif // BLE_LORA_ADAPTER_TRACE_H
@@ -1,25 +1,227 @@
+import re
 import shutil
+from dataclasses import dataclass, field
 from pathlib import Path
 import click
 import subprocess
+import yaml
 
 pwd = Path(__file__).parent
+inc = pwd.parent / "inc"
 
-files = ["hr_data", "query_device_by_mac", "query_device_by_mac_r", "set_name_map_key", "common"]
+files = ["hr_data", "hr_data_v2", "query_device_by_mac", "query_device_by_mac_r", "set_name_map_key", "beacon", "relay", "command", "ack", "roster", "lease_short_addr", "query_device_by_short", "query_device_by_short_r", "set_name_map_key_short", "bundle", "hr_data_redundant", "load_control", "hr_alarm", "hrv_summary", "hr_aggregate", "set_report_mode", "query_diagnostics", "diagnostics_response", "common"]
 
-kaitai = shutil.which("kaitai-struct-compiler")
-dot = shutil.which("dot")
+# `field::*` descriptors in `layout.tpp` -> kaitai type
+FIELD_TYPES = {
+    "u8": {"type": "u1"},
+    "u16": {"type": "u2"},
+    "i8": {"type": "s1"},
+    "i16": {"type": "s2"},
+    "key": {"type": "common::name_map_key"},
+    "addr": {"type": "common::ble_addr"},
+    "short_addr": {"type": "common::short_addr"},
+}
 
-if not kaitai:
-    raise RuntimeError("kaitai-struct-compiler not found in PATH")
+STRUCT_RE = re.compile(r"^(?:(?P<doc>/\*\*(?:(?!\*/).)*\*/)\n)?struct (?P<name>\w+) \{\n(?P<body>.*?)^\};", re.S | re.M)
+MAGIC_RE = re.compile(r"static constexpr uint8_t magic\s*=\s*(?P<magic>0x[0-9a-fA-F]+);")
+T_RE = re.compile(r"^  struct t \{\n(?P<body>.*?)^  \};", re.S | re.M)
+LAYOUT_RE = re.compile(r"using layout = fixed_layout<t,(?P<fields>.*?)>;", re.S)
+FIELD_RE = re.compile(r"field::(?P<kind>\w+)(?:<&?(?:t::)?(?P<arg>\w+)>)?")
+MEMBER_RE = re.compile(r"^\s*(?P<type>[\w:<>]+)\s+(?P<name>\w+)\s*(?:\{\}|=[^;]*)?;")
+ENUM_RE = re.compile(r"enum class (?P<name>\w+) : uint8_t \{(?P<body>.*?)\};", re.S)
+ENUMERATOR_RE = re.compile(r"^\s*(?P<name>\w+)\s*=\s*(?P<value>\w+),?", re.M)
+CONSTANT_RE = re.compile(r"static constexpr size_t (?P<name>\w+)\s*=\s*(?P<value>\d+);")
+ARRAY_RE = re.compile(r"using (?P<name>\w+)\s*=\s*std::array<uint8_t,\s*(?P<size>\w+)>;")
 
-if not dot:
-    raise RuntimeError("Graphviz (dot) not found in PATH")
+
+@dataclass
+class Message:
+    name: str
+    magic: int
+    doc: str
+    fields: list = field(default_factory=list)
+    member_docs: dict = field(default_factory=dict)
+    member_types: dict = field(default_factory=dict)
+    # enum name -> [(value, name)]
+    enums: dict = field(default_factory=dict)
+    # `std::array<uint8_t, N>` alias -> N
+    arrays: dict = field(default_factory=dict)
+
+
+def strip_comment(comment: str) -> str:
+    lines = []
+    for line in comment.splitlines():
+        line = line.strip().removeprefix("/**").removesuffix("*/").removeprefix("///").removeprefix("*").strip()
+        line = line.removeprefix("@brief").removeprefix("@note").strip()
+        if line:
+            lines.append(line)
+    return "\n".join(lines)
+
+
+def parse_members(body: str) -> tuple[dict, dict]:
+    """the doc comments (`///` or `/** */`) and the types of the members of `t`"""
+    docs = {}
+    types = {}
+    pending = []
+    in_block = False
+    for line in body.splitlines():
+        stripped = line.strip()
+        if in_block or stripped.startswith("/**"):
+            pending.append(stripped)
+            in_block = not stripped.endswith("*/")
+            continue
+        if stripped.startswith("///"):
+            pending.append(stripped)
+            continue
+        m = MEMBER_RE.match(line)
+        if m:
+            types[m.group("name")] = m.group("type")
+            if pending:
+                docs[m.group("name")] = strip_comment("\n".join(pending))
+        pending = []
+    return docs, types
+
+
+def parse_messages(path: Path) -> list[Message]:
+    """the module structs with a `fixed_layout` in a header"""
+    messages = []
+    for s in STRUCT_RE.finditer(path.read_text()):
+        body = s.group("body")
+        layout = LAYOUT_RE.search(body)
+        magic = MAGIC_RE.search(body)
+        if not layout or not magic:
+            continue
+        t = T_RE.search(body)
+        docs, types = parse_members(t.group("body")) if t else ({}, {})
+        msg = Message(name=s.group("name"),
+                      magic=int(magic.group("magic"), 16),
+                      doc=strip_comment(s.group("doc") or ""),
+                      member_docs=docs,
+                      member_types=types)
+        for e in ENUM_RE.finditer(body):
+            msg.enums[e.group("name")] = [(int(m.group("value"), 0), m.group("name"))
+                                          for m in ENUMERATOR_RE.finditer(e.group("body"))]
+        constants = {c.group("name"): int(c.group("value")) for c in CONSTANT_RE.finditer(body)}
+        for a in ARRAY_RE.finditer(body):
+            size = a.group("size")
+            msg.arrays[a.group("name")] = constants[size] if size in constants else int(size, 0)
+        for f in FIELD_RE.finditer(layout.group("fields")):
+            msg.fields.append((f.group("kind"), f.group("arg")))
+        messages.append(msg)
+    return messages
+
+
+def indent(text: str, prefix: str) -> str:
+    return "\n".join(prefix + line for line in text.splitlines())
+
+
+@dataclass
+class Existing:
+    """the parts of a `.ksy` file kept when it's generated again, which the Kaitai users depend on"""
+    title: str | None = None
+    doc: str | None = None
+    # the entries of `seq`, in order
+    seq: list = field(default_factory=list)
+    # enum name -> {value: enumerator}
+    enums: dict = field(default_factory=dict)
+
+    @staticmethod
+    def load(path: Path) -> "Existing":
+        if not path.exists():
+            return Existing()
+        ksy = yaml.safe_load(path.read_text()) or {}
+        enums = {name: {int(value): enumerator for value, enumerator in values.items()}
+                 for name, values in (ksy.get("enums") or {}).items()}
+        return Existing(title=(ksy.get("meta") or {}).get("title"),
+                        doc=ksy.get("doc"),
+                        seq=ksy.get("seq") or [],
+                        enums=enums)
+
+    def entry(self, index: int, count: int, id: str) -> dict:
+        """the existing entry of the field, by its position if the number of the fields is not changed"""
+        if len(self.seq) == count:
+            return self.seq[index]
+        return next((e for e in self.seq if e.get("id") == id), {})
+
+
+def doc_entry(doc: str, prefix: str) -> str:
+    """a block scalar, unless it's a single line without the trailing newline (i.e. written inline)"""
+    if not doc.endswith("\n") and "\n" not in doc:
+        return f"{prefix}doc: {doc}"
+    return f"{prefix}doc: |\n" + indent(doc.rstrip("\n"), prefix + "  ")
+
+
+def to_ksy(msg: Message, source: str, existing: Existing) -> str:
+    """the layout follows the header. The title, the docs, the ids and the enum names
+    are kept from the existing `.ksy` file, which are what the Kaitai users see."""
+    seq = []
+    # enum name in the header -> name in the .ksy
+    enum_names = {}
+    for index, (kind, arg) in enumerate(msg.fields):
+        if kind == "magic":
+            id = f"magic_0x{msg.magic:02x}"
+            doc = f"a magic number (0x{msg.magic:02x})"
+            lines = [f"contents: [0x{msg.magic:02x}]"]
+        elif kind == "crc8":
+            id = "crc8"
+            doc = "CRC-8 (polynomial 0x07, initial value 0) of all the preceding bytes.\n"
+            lines = ["type: u1"]
+        elif kind == "bytes":
+            member_type = msg.member_types.get(arg)
+            if member_type not in msg.arrays:
+                raise RuntimeError(f"unknown size of `{arg}` in {msg.name}")
+            id = arg
+            doc = msg.member_docs.get(arg)
+            lines = [f"size: {msg.arrays[member_type]}"]
+        elif kind in FIELD_TYPES:
+            id = arg
+            doc = msg.member_docs.get(arg)
+            lines = [f"type: {FIELD_TYPES[kind]['type']}"]
+        else:
+            raise RuntimeError(f"unknown field `{kind}` in {msg.name}")
+        old = existing.entry(index, len(msg.fields), id)
+        id = old.get("id", id)
+        doc = old.get("doc", doc + "\n" if doc and kind != "magic" else doc)
+        member_type = msg.member_types.get(arg)
+        if member_type in msg.enums:
+            enum_names[member_type] = old.get("enum", enum_names.get(member_type, member_type))
+            lines.append(f"enum: {enum_names[member_type]}")
+        entry = f"  - id: {id}\n" + "".join(f"    {line}\n" for line in lines)
+        if doc:
+            entry += doc_entry(doc, "    ") + "\n"
+        seq.append(entry)
+    imports = any(FIELD_TYPES.get(kind, {}).get("type", "").startswith("common::") for kind, _ in msg.fields)
+    title = existing.title or msg.name.replace("_", " ").capitalize()
+    meta = f"meta:\n  id: {msg.name}\n  title: {title}\n"
+    if imports:
+        meta += "  imports:\n    - common\n"
+    meta += "  endian: be\n"
+    out = (f"# generated by gen.py from inc/{source}. The layout follows the header, while the title,\n"
+           f"# the docs, the ids and the enum names are kept when generated again.\n{meta}\n")
+    doc = existing.doc or msg.doc
+    if doc:
+        out += "doc: |\n" + indent(doc.rstrip("\n"), "  ") + "\n\n"
+    out += "seq:\n" + "".join(seq)
+    if enum_names:
+        out += "\nenums:\n"
+        for name, ksy_name in enum_names.items():
+            old = existing.enums.get(ksy_name, {})
+            out += f"  {ksy_name}:\n" + "".join(f"    {value}: {old.get(value, enumerator)}\n"
+                                                 for value, enumerator in msg.enums[name])
+    return out
+
+
+def gen_ksy(inc_dir: Path, out_dir: Path):
+    for header in sorted(inc_dir.glob("*.tpp")):
+        for msg in parse_messages(header):
+            out = out_dir / f"{msg.name}.ksy"
+            out.write_text(to_ksy(msg, header.name, Existing.load(out)))
+            click.echo(f"{header.name} -> {msg.name}.ksy")
 
 
 # kaitai-struct-compiler -t graphviz -d $SCRIPT_DIR $SCRIPT_DIR/spot.ksy
 # dot -Tpng $SCRIPT_DIR/spot.dot > $FIGURE_DIR/spot.png
-def gen(file: str, src_dir: Path, out_dir: Path):
+def gen(file: str, src_dir: Path, out_dir: Path, kaitai: str, dot: str):
     input_file = src_dir / f"{file}.ksy"
     if not input_file.exists():
         raise RuntimeError(f"Input file {input_file} does not exist")
@@ -28,16 +230,37 @@ def gen(file: str, src_dir: Path, out_dir: Path):
     subprocess.run([dot, "-Tpng", str(out_dir / f"{file}.dot"), "-o", str(out_dir / f"{file}.png")], check=True)
 
 
-@click.command()
+@click.group(invoke_without_command=True)
+@click.pass_context
+def main(ctx: click.Context):
+    if ctx.invoked_subcommand is None:
+        ctx.invoke(ksy)
+        ctx.invoke(figures)
+
+
+@main.command(help="emit the .ksy files of the fixed-size messages from the `fixed_layout` in the headers")
+@click.option("--inc", "-i", "inc_dir", type=click.Path(exists=True, file_okay=False), default=inc)
+@click.option("--dst", "-d", type=click.Path(exists=True, file_okay=False), default=pwd)
+def ksy(inc_dir: str, dst: str):
+    gen_ksy(Path(inc_dir), Path(dst))
+
+
+@main.command(help="render the .ksy files into figures")
 @click.option("--src", "-s", type=click.Path(exists=True, file_okay=False), default=pwd)
 @click.option("--dst", "-d", type=click.Path(exists=True, file_okay=False), default=pwd / "figures")
-def main(src: str, dst: str):
+def figures(src: str, dst: str):
+    kaitai = shutil.which("kaitai-struct-compiler")
+    dot = shutil.which("dot")
+    if not kaitai:
+        raise RuntimeError("kaitai-struct-compiler not found in PATH")
+    if not dot:
+        raise RuntimeError("Graphviz (dot) not found in PATH")
     src_dir = Path(src)
     dst_dir = Path(dst)
     if not dst_dir.exists():
         dst_dir.mkdir(parents=True)
     for file in files:
-        gen(file, src_dir, dst_dir)
+        gen(file, src_dir, dst_dir, kaitai, dot)
 
 
 main()
@@ -0,0 +1,299 @@
+#ifndef BLE_LORA_ADAPTER_ACK_H
+#define BLE_LORA_ADAPTER_ACK_H
+
+#include <span>
+#include <algorithm>
+#include <string>
+#include <etl/optional.h>
+#include "hr_lora_common.tpp"
+#include "layout.tpp"
+
+namespace HrLoRa {
+/**
+ * @brief an envelope of a control command (e.g. `set_name_map_key`) which requires an `ack`
+ * @note the hub increases `cmd_id` for each new command and keeps it for the retransmissions,
+ *       so that the repeater could tell a retransmission from a new command.
+ */
+struct command {
+  static constexpr uint8_t magic            = 0x3c;
+  static constexpr size_t max_payload_size  = 64;
+  /// the largest response (e.g. `query_device_by_short_response`) to a command, which is cached with its `ack`
+  static constexpr size_t max_response_size = 64;
+  struct t {
+    using module   = command;
+    uint8_t cmd_id = 0;
+    /**
+     * @brief the wrapped control frame, starting with its own magic
+     * @note borrowed from the receive buffer. The user should keep the buffer alive.
+     */
+    std::span<const uint8_t> payload{};
+  };
+  static size_t size_needed(const t &data) {
+    return sizeof(magic) + sizeof(t::cmd_id) + data.payload.size();
+  }
+  static size_t marshal(const t &data, uint8_t *buffer, size_t size) {
+    if (data.payload.empty() || data.payload.size() > max_payload_size) {
+      return 0;
+    }
+    if (size < size_needed(data)) {
+      return 0;
+    }
+    buffer[0] = magic;
+    buffer[1] = data.cmd_id;
+    std::copy(data.payload.begin(), data.payload.end(), buffer + 2);
+    return size_needed(data);
+  }
+  static etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
+    // magic + cmd_id + at least the magic of payload
+    if (size < 3) {
+      return etl::nullopt;
+    }
+    if (buffer[0] != magic) {
+      return etl::nullopt;
+    }
+    t data;
+    data.cmd_id  = buffer[1];
+    data.payload = std::span<const uint8_t>{buffer + 2, size - 2};
+    return data;
+  }
+};
+
+/**
+ * @brief sent by the repeater after handling a `command` addressed to it
+ */
+struct ack {
+  static constexpr uint8_t magic = 0x3d;
+  enum class status_t : uint8_t {
+    ok = 0,
+    /// the command is applied but could not be persisted
+    failed = 1,
+  };
+  struct t {
+    using module   = ack;
+    /// the `cmd_id` of the acknowledged `command`
+    uint8_t cmd_id = 0;
+    addr_t repeater_addr{};
+    /// the command is applied whatever the status is
+    status_t status = status_t::ok;
+  };
+  using layout = fixed_layout<t,
+                              field::magic<magic>,
+                              field::u8<&t::cmd_id>,
+                              field::addr<&t::repeater_addr>,
+                              field::u8<&t::status>>;
+  static consteval size_t size_needed() {
+    return layout::size_needed();
+  }
+  static size_t marshal(const t &data, uint8_t *buffer, size_t size) {
+    return layout::marshal(data, buffer, size);
+  }
+  static etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
+    return layout::unmarshal(buffer, size);
+  }
+};
+
+/**
+ * @brief remember the recently handled `cmd_id` on the repeater side, so that a retransmitted
+ *        command is answered again (with the same response and `ack`) without being applied twice
+ * @tparam N the number of entries. The oldest entry is evicted when the cache is full.
+ * @note an entry expires after `ttl_ms`, in case the hub restarts its `cmd_id` from 0
+ */
+template <size_t N>
+class command_cache {
+  struct entry_t {
+    uint8_t cmd_id       = 0;
+    ack::status_t status = ack::status_t::ok;
+    uint8_t response[command::max_response_size]{};
+    size_t response_size = 0;
+    etl::optional<uint8_t> rank{};
+    uint32_t time_ms     = 0;
+    bool valid           = false;
+  };
+  std::array<entry_t, N> entries{};
+  size_t next = 0;
+
+public:
+  struct cached_t {
+    ack::status_t status;
+    /**
+     * @brief the response sent before the `ack`, empty if none
+     * @note borrowed from the cache, which is valid until the next `insert`
+     */
+    std::span<const uint8_t> response;
+    /// the position among the repeaters answering the same command (e.g. `roster::t::index_of`)
+    etl::optional<uint8_t> rank;
+  };
+
+  /**
+   * @return the status and the response of the command if it has been handled in `ttl_ms`
+   */
+  etl::optional<cached_t> find(uint8_t cmd_id, uint32_t now_ms, uint32_t ttl_ms) const {
+    for (const auto &e : entries) {
+      if (e.valid && e.cmd_id == cmd_id && now_ms - e.time_ms < ttl_ms) {
+        return cached_t{
+            .status   = e.status,
+            .response = std::span<const uint8_t>{e.response, e.response_size},
+            .rank     = e.rank,
+        };
+      }
+    }
+    return etl::nullopt;
+  }
+
+  /**
+   * @param response the marshalled response, empty if none
+   * @param rank see `cached_t::rank`
+   * @return false if the response is larger than `command::max_response_size`, which is not cached
+   *         (the command is still remembered)
+   */
+  bool insert(uint8_t cmd_id, ack::status_t status, std::span<const uint8_t> response,
+              etl::optional<uint8_t> rank, uint32_t now_ms) {
+    auto &e = entries[next];
+    e       = entry_t{
+        .cmd_id  = cmd_id,
+        .status  = status,
+        .rank    = rank,
+        .time_ms = now_ms,
+        .valid   = true,
+    };
+    next          = (next + 1) % N;
+    const bool ok = response.size() <= sizeof(e.response);
+    if (ok) {
+      std::copy(response.begin(), response.end(), e.response);
+      e.response_size = response.size();
+    }
+    return ok;
+  }
+};
+
+/**
+ * @brief retransmit the unacknowledged commands with exponential backoff, on the hub side
+ * @tparam N the number of commands in flight
+ * @tparam MAX_RECIPIENTS the repeaters a command (e.g. a `roster`, or a broadcast) could address
+ * @note the caller should call `poll` periodically and transmit whatever it returns.
+ *       A command is sent for the first time on the first `poll` after `push`.
+ * @note a command is retransmitted until every recipient has acknowledged it, or `max_attempts`
+ *       runs out. The recipients that have acknowledged it answer the retransmission from
+ *       their `command_cache`, without applying it again.
+ */
+template <size_t N, size_t MAX_FRAME_SIZE = command::max_payload_size + 2, size_t MAX_RECIPIENTS = 16>
+class retry_queue {
+  static_assert(MAX_RECIPIENTS <= 32, "the pending recipients are a 32-bit mask");
+
+public:
+  struct config_t {
+    uint32_t initial_timeout_ms = 250;
+    uint32_t max_timeout_ms     = 4000;
+    uint8_t max_attempts        = 6;
+  };
+
+private:
+  struct entry_t {
+    uint8_t frame[MAX_FRAME_SIZE]{};
+    size_t size      = 0;
+    uint8_t cmd_id   = 0;
+    uint8_t attempts = 0;
+    uint32_t due_ms  = 0;
+    std::array<addr_t, MAX_RECIPIENTS> recipients{};
+    size_t recipient_count = 0;
+    /// bit `i` is set until `recipients[i]` acknowledges the command
+    uint32_t pending       = 0;
+    bool active            = false;
+  };
+  config_t config;
+  std::array<entry_t, N> entries{};
+  size_t _failed_count = 0;
+
+public:
+  explicit retry_queue(config_t config = config_t{}) : config(config) {}
+
+  /**
+   * @param frame a marshalled `command`
+   * @param recipients the repeaters expected to acknowledge it, e.g. the addresses in a `roster`,
+   *        or the known repeaters for a broadcast
+   * @return false if the queue is full, the frame is too large, or the recipients are none or too many
+   */
+  bool push(uint8_t cmd_id, const uint8_t *frame, size_t size, std::span<const addr_t> recipients, uint32_t now_ms) {
+    if (size > MAX_FRAME_SIZE || recipients.empty() || recipients.size() > MAX_RECIPIENTS) {
+      return false;
+    }
+    auto it = std::find_if(entries.begin(), entries.end(), [](const entry_t &e) { return !e.active; });
+    if (it == entries.end()) {
+      return false;
+    }
+    std::copy(frame, frame + size, it->frame);
+    it->size     = size;
+    it->cmd_id   = cmd_id;
+    it->attempts = 0;
+    it->due_ms   = now_ms;
+    std::copy(recipients.begin(), recipients.end(), it->recipients.begin());
+    it->recipient_count = recipients.size();
+    it->pending         = recipients.size() == 32 ? UINT32_MAX : (1u << recipients.size()) - 1;
+    it->active          = true;
+    return true;
+  }
+
+  /**
+   * @brief retire the command once every recipient has acknowledged it
+   * @return true if the command is in flight and `a` is from one of its recipients
+   */
+  bool on_ack(const ack::t &a) {
+    for (auto &e : entries) {
+      if (!e.active || e.cmd_id != a.cmd_id) {
+        continue;
+      }
+      const auto end = e.recipients.begin() + e.recipient_count;
+      const auto it  = std::find(e.recipients.begin(), end, a.repeater_addr);
+      if (it == end) {
+        return false;
+      }
+      e.pending &= ~(1u << (it - e.recipients.begin()));
+      if (e.pending == 0) {
+        e.active = false;
+      }
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * @brief take a command due for (re)transmission
+   * @param jitter_ms a random value added to the backoff, to avoid retransmissions in lockstep
+   * @return the size of the frame copied into `buffer`, 0 if nothing is due
+   */
+  size_t poll(uint32_t now_ms, uint8_t *buffer, size_t size, uint32_t jitter_ms = 0) {
+    for (auto &e : entries) {
+      if (!e.active || static_cast<int32_t>(now_ms - e.due_ms) < 0) {
+        continue;
+      }
+      if (e.attempts >= config.max_attempts) {
+        e.active = false;
+        _failed_count += 1;
+        continue;
+      }
+      if (size < e.size) {
+        return 0;
+      }
+      auto timeout = std::min(config.initial_timeout_ms << e.attempts, config.max_timeout_ms);
+      e.attempts += 1;
+      e.due_ms = now_ms + timeout + jitter_ms;
+      std::copy(e.frame, e.frame + e.size, buffer);
+      return e.size;
+    }
+    return 0;
+  }
+
+  [[nodiscard]] bool empty() const {
+    return std::none_of(entries.begin(), entries.end(), [](const entry_t &e) { return e.active; });
+  }
+
+  /**
+   * @return the number of commands given up after `max_attempts`
+   */
+  [[nodiscard]] size_t failed_count() const {
+    return _failed_count;
+  }
+};
+}
+
+#endif // BLE_LORA_ADAPTER_ACK_H
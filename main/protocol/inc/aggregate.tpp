@@ -0,0 +1,88 @@
+#ifndef BLE_LORA_ADAPTER_AGGREGATE_H
+#define BLE_LORA_ADAPTER_AGGREGATE_H
+
+#include <string>
+#include <etl/optional.h>
+#include "hr_lora_common.tpp"
+#include "layout.tpp"
+
+namespace HrLoRa {
+/**
+ * @brief the heart rate statistics of a window, sent by the repeater in the aggregate mode
+ * @sa set_report_mode
+ */
+struct hr_aggregate {
+  static constexpr uint8_t magic = 0x67;
+  struct t {
+    using module      = hr_aggregate;
+    uint8_t key       = 0;
+    /// increased by one for each window, wraps around
+    uint8_t seq       = 0;
+    uint8_t min       = 0;
+    /// the mean heart rate, rounded
+    uint8_t avg       = 0;
+    uint8_t max       = 0;
+    /// the number of the samples in the window
+    uint16_t count    = 0;
+    /// the length of the window in seconds
+    uint16_t window_s = 0;
+  };
+  using layout = fixed_layout<t,
+                              field::magic<magic>,
+                              field::key<&t::key>,
+                              field::u8<&t::seq>,
+                              field::u8<&t::min>,
+                              field::u8<&t::avg>,
+                              field::u8<&t::max>,
+                              field::u16<&t::count>,
+                              field::u16<&t::window_s>,
+                              field::crc8>;
+  static consteval size_t size_needed() {
+    return layout::size_needed();
+  }
+  static size_t marshal(const t &data, uint8_t *buffer, size_t size) {
+    return layout::marshal(data, buffer, size);
+  }
+  static etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
+    return layout::unmarshal(buffer, size);
+  }
+};
+
+/**
+ * @brief switch a repeater (or all of them) between the raw `hr_data` and `hr_aggregate`
+ * @note not persisted. A repeater starts in the raw mode.
+ */
+struct set_report_mode {
+  static constexpr uint8_t magic = 0x6d;
+  enum class mode_t : uint8_t {
+    /// `hr_data` (subject to the reporting policy)
+    raw       = 0,
+    /// `hr_aggregate` once per window
+    aggregate = 1,
+  };
+  struct t {
+    using module            = set_report_mode;
+    /// `broadcast_short_addr` for all the repeaters
+    short_addr_t short_addr = broadcast_short_addr;
+    mode_t mode             = mode_t::raw;
+    /// the length of the window in seconds. Only used by `mode_t::aggregate`; 0 to keep the current one.
+    uint16_t window_s       = 0;
+  };
+  using layout = fixed_layout<t,
+                              field::magic<magic>,
+                              field::short_addr<&t::short_addr>,
+                              field::u8<&t::mode>,
+                              field::u16<&t::window_s>>;
+  static consteval size_t size_needed() {
+    return layout::size_needed();
+  }
+  static size_t marshal(const t &data, uint8_t *buffer, size_t size) {
+    return layout::marshal(data, buffer, size);
+  }
+  static etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
+    return layout::unmarshal(buffer, size);
+  }
+};
+}
+
+#endif // BLE_LORA_ADAPTER_AGGREGATE_H
@@ -0,0 +1,55 @@
+#ifndef BLE_LORA_ADAPTER_ALARM_H
+#define BLE_LORA_ADAPTER_ALARM_H
+
+#include <string>
+#include <etl/optional.h>
+#include "hr_lora_common.tpp"
+#include "layout.tpp"
+
+namespace HrLoRa {
+/**
+ * @brief sent by the repeater as soon as the heart rate crosses a configured limit
+ * @note sent out of the TDMA slot (with CAD), and never suppressed by the reporting policy.
+ *       Sent once, as there's no acknowledgement; a relayed copy carries the same `alarm_id`,
+ *       so the hub could drop the duplicates.
+ * @note cleared only a few bpm back within the limit, and at most one alarm of a level is raised
+ *       in a while (see `telemetry::AlarmDetector`). A heart rate of 0 (no skin contact) raises none.
+ */
+struct hr_alarm {
+  static constexpr uint8_t magic = 0x61;
+  enum class level_t : uint8_t {
+    /// back within the limits, which clears the previous alarm
+    normal = 0,
+    low    = 1,
+    high   = 2,
+  };
+  struct t {
+    using module     = hr_alarm;
+    uint8_t key      = 0;
+    /// increased by one for each new alarm of the repeater, wraps around
+    uint8_t alarm_id = 0;
+    /// the range the heart rate has entered
+    level_t level    = level_t::normal;
+    /// the heart rate in beats per minute
+    uint8_t hr       = 0;
+  };
+  using layout = fixed_layout<t,
+                              field::magic<magic>,
+                              field::key<&t::key>,
+                              field::u8<&t::alarm_id>,
+                              field::u8<&t::level>,
+                              field::u8<&t::hr>,
+                              field::crc8>;
+  static consteval size_t size_needed() {
+    return layout::size_needed();
+  }
+  static size_t marshal(const t &data, uint8_t *buffer, size_t size) {
+    return layout::marshal(data, buffer, size);
+  }
+  static etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
+    return layout::unmarshal(buffer, size);
+  }
+};
+}
+
+#endif // BLE_LORA_ADAPTER_ALARM_H
@@ -0,0 +1,65 @@
+#ifndef BLE_LORA_ADAPTER_BEACON_H
+#define BLE_LORA_ADAPTER_BEACON_H
+
+#include <string>
+#include <etl/optional.h>
+#include "hr_lora_common.tpp"
+#include "layout.tpp"
+
+namespace HrLoRa {
+/**
+ * @brief broadcast periodically by the hub to start a TDMA superframe
+ * @note the beacon itself occupies slot 0. Repeater with key `k` transmits
+ *       in slot `1 + k % (slot_count() - 1)`, where the slot is counted from
+ *       the end of the beacon reception.
+ */
+struct beacon {
+  static constexpr uint8_t magic = 0x2b;
+  struct t {
+    using module = beacon;
+    /// rolling counter, incremented by the hub for each beacon
+    uint8_t seq            = 0;
+    /// length of the whole superframe (including the beacon slot) in milliseconds
+    uint16_t superframe_ms = 0;
+    /// length of a slot in milliseconds
+    uint8_t slot_ms        = 0;
+
+    /**
+     * @return the number of slots in a superframe (including the beacon slot)
+     */
+    [[nodiscard]] constexpr size_t slot_count() const {
+      if (slot_ms == 0) {
+        return 0;
+      }
+      return superframe_ms / slot_ms;
+    }
+
+    /**
+     * @return the slot index for the key, or 0 (the beacon slot) if the beacon is malformed
+     */
+    [[nodiscard]] constexpr size_t slot_of(name_map_key_t key) const {
+      auto count = slot_count();
+      if (count < 2) {
+        return 0;
+      }
+      return 1 + key % (count - 1);
+    }
+  };
+  using layout = fixed_layout<t,
+                              field::magic<magic>,
+                              field::u8<&t::seq>,
+                              field::u16<&t::superframe_ms>,
+                              field::u8<&t::slot_ms>>;
+  static consteval size_t size_needed() {
+    return layout::size_needed();
+  }
+  static size_t marshal(const t &data, uint8_t *buffer, size_t size) {
+    return layout::marshal(data, buffer, size);
+  }
+  static etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
+    return layout::unmarshal(buffer, size);
+  }
+};
+}
+
+#endif // BLE_LORA_ADAPTER_BEACON_H
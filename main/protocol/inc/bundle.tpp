@@ -0,0 +1,169 @@
+#ifndef BLE_LORA_ADAPTER_BUNDLE_H
+#define BLE_LORA_ADAPTER_BUNDLE_H
+
+#include <span>
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <etl/optional.h>
+#include "hr_lora_common.tpp"
+
+namespace HrLoRa {
+/**
+ * @brief several messages in one LoRa packet, each prefixed with its length (`u8`)
+ * @note e.g. a `query_device_by_mac_response` and the pending `hr_data` could share
+ *       one transmission, which saves a preamble and a chance of collision.
+ *       A nested `bundle` is not allowed.
+ */
+struct bundle {
+  static constexpr uint8_t magic = 0x42;
+
+  /**
+   * @brief walk the sub-messages without copying
+   * @note stops at the first malformed sub-message (zero length, or longer than the rest)
+   */
+  class iterator {
+    std::span<const uint8_t> rest{};
+
+    [[nodiscard]] size_t current_size() const {
+      if (rest.empty() || rest[0] == 0 || rest[0] >= rest.size()) {
+        return 0;
+      }
+      return rest[0];
+    }
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type        = std::span<const uint8_t>;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = void;
+    using reference         = value_type;
+
+    iterator() = default;
+    explicit iterator(std::span<const uint8_t> payload) : rest(payload) {
+      if (current_size() == 0) {
+        rest = {};
+      }
+    }
+
+    /**
+     * @return the sub-message, starting with its own magic
+     */
+    value_type operator*() const {
+      return rest.subspan(1, current_size());
+    }
+
+    iterator &operator++() {
+      rest = rest.subspan(1 + current_size());
+      if (current_size() == 0) {
+        rest = {};
+      }
+      return *this;
+    }
+
+    iterator operator++(int) {
+      auto tmp = *this;
+      ++*this;
+      return tmp;
+    }
+
+    bool operator==(const iterator &other) const {
+      return rest.data() == other.rest.data() && rest.size() == other.rest.size();
+    }
+  };
+
+  struct t {
+    using module = bundle;
+    /**
+     * @brief the length-prefixed sub-messages
+     * @note borrowed from the receive buffer. The user should keep the buffer alive.
+     */
+    std::span<const uint8_t> payload{};
+
+    [[nodiscard]] iterator begin() const {
+      return iterator{payload};
+    }
+
+    [[nodiscard]] iterator end() const {
+      return iterator{};
+    }
+  };
+
+  /**
+   * @brief append the sub-messages into a buffer, on the sender side
+   */
+  class builder {
+    uint8_t *buffer;
+    size_t capacity;
+    size_t offset = 0;
+    size_t _count = 0;
+
+  public:
+    builder(uint8_t *buffer, size_t size) : buffer(buffer), capacity(size) {
+      if (capacity >= sizeof(magic)) {
+        buffer[offset++] = magic;
+      }
+    }
+
+    /**
+     * @param frame a marshalled message, starting with its own magic
+     * @return false if the frame doesn't fit or is not allowed in a bundle
+     */
+    bool append(std::span<const uint8_t> frame) {
+      if (frame.empty() || frame.size() > UINT8_MAX || frame[0] == magic) {
+        return false;
+      }
+      if (offset == 0 || capacity - offset < frame.size() + 1) {
+        return false;
+      }
+      buffer[offset++] = frame.size();
+      std::copy(frame.begin(), frame.end(), buffer + offset);
+      offset += frame.size();
+      _count += 1;
+      return true;
+    }
+
+    /**
+     * @return the number of the sub-messages
+     */
+    [[nodiscard]] size_t count() const {
+      return _count;
+    }
+
+    /**
+     * @return the size of the bundle, 0 if nothing is appended
+     */
+    [[nodiscard]] size_t size() const {
+      return _count == 0 ? 0 : offset;
+    }
+  };
+
+  static size_t size_needed(const t &data) {
+    return sizeof(magic) + data.payload.size();
+  }
+
+  static size_t marshal(const t &data, uint8_t *buffer, size_t size) {
+    if (size < size_needed(data)) {
+      return 0;
+    }
+    buffer[0] = magic;
+    std::copy(data.payload.begin(), data.payload.end(), buffer + 1);
+    return size_needed(data);
+  }
+
+  static etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
+    // magic + length + at least the magic of a sub-message
+    if (size < 3) {
+      return etl::nullopt;
+    }
+    if (buffer[0] != magic) {
+      return etl::nullopt;
+    }
+    t data;
+    data.payload = std::span<const uint8_t>{buffer + 1, size - 1};
+    return data;
+  }
+};
+}
+
+#endif // BLE_LORA_ADAPTER_BUNDLE_H
@@ -0,0 +1,121 @@
+#ifndef BLE_LORA_ADAPTER_DIAGNOSTICS_H
+#define BLE_LORA_ADAPTER_DIAGNOSTICS_H
+
+#include <array>
+#include <etl/optional.h>
+#include "hr_lora_common.tpp"
+#include "layout.tpp"
+
+namespace HrLoRa {
+/**
+ * @brief ask a repeater (or all of them) for its radio link metrics
+ * @note answered in the TDMA slot of the repeater, or after a random delay if not synced,
+ *       so that the answers to a broadcast query don't collide
+ * @sa diagnostics_response
+ */
+struct query_diagnostics {
+  static constexpr uint8_t magic = 0x39;
+  struct t {
+    using module            = query_diagnostics;
+    /// `broadcast_short_addr` to query all the repeaters
+    short_addr_t short_addr = broadcast_short_addr;
+  };
+  using layout = fixed_layout<t,
+                              field::magic<magic>,
+                              field::short_addr<&t::short_addr>>;
+  static consteval size_t size_needed() {
+    return layout::size_needed();
+  }
+  static size_t marshal(const t &data, uint8_t *buffer, size_t size) {
+    return layout::marshal(data, buffer, size);
+  }
+  static etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
+    return layout::unmarshal(buffer, size);
+  }
+};
+
+/**
+ * @brief the radio link metrics of a repeater
+ * @note the counters are since boot and wrap around; the hub should take the difference
+ *       of two responses. The link quality is of the last `window_size` received packets.
+ */
+struct diagnostics_response {
+  static constexpr uint8_t magic = 0x49;
+  /// the number of the packets the link quality is computed from
+  static constexpr size_t window_size          = 32;
+  static constexpr size_t rssi_histogram_size  = 8;
+  /// the lower bound of `rssi_histogram[1]` in dBm
+  static constexpr int8_t rssi_histogram_floor = -120;
+  static constexpr int8_t rssi_histogram_step  = 10;
+  using rssi_histogram_t                       = std::array<uint8_t, rssi_histogram_size>;
+  struct t {
+    using module            = diagnostics_response;
+    short_addr_t short_addr = unassigned_short_addr;
+    name_map_key_t key      = 0;
+    /// the packets received without an error
+    uint16_t rx_count       = 0;
+    uint16_t crc_errors     = 0;
+    /// 0 if the radio couldn't tell a header error from a CRC error
+    uint16_t header_errors  = 0;
+    /// the packets dropped as the parser couldn't keep up
+    uint16_t rx_dropped     = 0;
+    uint16_t tx_count       = 0;
+    uint16_t tx_timeouts    = 0;
+    /// in dBm, of the window
+    int8_t rssi_avg         = 0;
+    int8_t rssi_min         = 0;
+    int8_t rssi_max         = 0;
+    /// in 0.25 dB, of the window
+    int8_t snr_avg          = 0;
+    /// in 0.25 dB, of the window
+    int8_t snr_min          = 0;
+    /// in Hz, of the window
+    int16_t freq_error_avg  = 0;
+    /**
+     * @brief the number of the packets in the window by RSSI, 10 dB per bucket
+     * @note the first bucket is below -120 dBm, and the last one is -60 dBm and above
+     */
+    rssi_histogram_t rssi_histogram{};
+  };
+  using layout = fixed_layout<t,
+                              field::magic<magic>,
+                              field::short_addr<&t::short_addr>,
+                              field::key<&t::key>,
+                              field::u16<&t::rx_count>,
+                              field::u16<&t::crc_errors>,
+                              field::u16<&t::header_errors>,
+                              field::u16<&t::rx_dropped>,
+                              field::u16<&t::tx_count>,
+                              field::u16<&t::tx_timeouts>,
+                              field::i8<&t::rssi_avg>,
+                              field::i8<&t::rssi_min>,
+                              field::i8<&t::rssi_max>,
+                              field::i8<&t::snr_avg>,
+                              field::i8<&t::snr_min>,
+                              field::i16<&t::freq_error_avg>,
+                              field::bytes<&t::rssi_histogram>,
+                              field::crc8>;
+  static consteval size_t size_needed() {
+    return layout::size_needed();
+  }
+  static size_t marshal(const t &data, uint8_t *buffer, size_t size) {
+    return layout::marshal(data, buffer, size);
+  }
+  static etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
+    return layout::unmarshal(buffer, size);
+  }
+
+  /**
+   * @return the index of the bucket in `rssi_histogram`
+   */
+  static constexpr size_t rssi_bucket(int16_t rssi_dbm) {
+    if (rssi_dbm < rssi_histogram_floor) {
+      return 0;
+    }
+    size_t i = 1 + (rssi_dbm - rssi_histogram_floor) / rssi_histogram_step;
+    return i < rssi_histogram_size ? i : rssi_histogram_size - 1;
+  }
+};
+}
+
+#endif // BLE_LORA_ADAPTER_DIAGNOSTICS_H
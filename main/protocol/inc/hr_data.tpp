@@ -7,41 +7,129 @@
 
 #include <string>
 #include <etl/optional.h>
+#include "hr_lora_common.tpp"
+#include "layout.tpp"
 
 namespace HrLoRa {
+/**
+ * @brief heart rate data transmitted by the repeater
+ * @note as the size is fixed, it could be sent in LoRa implicit header mode
+ *       (with a dedicated sync word) if the radio profile enables it
+ */
 struct hr_data {
   static constexpr uint8_t magic = 0x63;
   struct t {
     using module = hr_data;
     uint8_t key  = 0;
+    /// the heart rate in beats per minute
     uint8_t hr   = 0;
   };
+  using layout = fixed_layout<t,
+                              field::magic<magic>,
+                              field::key<&t::key>,
+                              field::u8<&t::hr>>;
   static consteval size_t size_needed() {
-    // key + hr + magic
-    return sizeof(magic) + sizeof(t::key) + sizeof(t::hr);
+    return layout::size_needed();
   }
-  static size_t marshal(const t &data, uint8_t *buffer, size_t buffer_size) {
-    if (buffer_size < size_needed()) {
+  static size_t marshal(const t &data, uint8_t *buffer, size_t size) {
+    return layout::marshal(data, buffer, size);
+  }
+  static etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
+    return layout::unmarshal(buffer, size);
+  }
+};
+
+/**
+ * @brief `hr_data` with a rolling sequence number and a CRC-8,
+ *        so that the hub could tell loss from silence and dedupe relayed frames.
+ * @note the optional fields are announced by `flags`, and the frame size is still
+ *       fixed for a radio profile (i.e. implicit header works).
+ */
+struct hr_data_v2 {
+  static constexpr uint8_t magic      = 0x64;
+  /// `link` follows `hr`
+  static constexpr uint8_t flag_link  = 0x01;
+  /// magic + flags + key + seq + hr
+  static constexpr size_t header_size = 5;
+  /**
+   * @brief the quality of the path from the heart rate monitor to the hub through this repeater
+   * @sa path_selector
+   */
+  struct link_t {
+    /// the value is not known (e.g. right after boot)
+    static constexpr int8_t missing = INT8_MIN;
+    /// the last known RSSI of the heart rate monitor in dBm
+    int8_t ble_rssi                 = missing;
+    /// the mean SNR of the recent packets received by the repeater, in 0.25 dB
+    int8_t lora_snr                 = missing;
+  };
+  struct t {
+    using module = hr_data_v2;
+    /// the bits other than `flag_link` are reserved. Should be 0.
+    uint8_t flags = 0;
+    uint8_t key   = 0;
+    /// increased by one for each transmitted frame, wraps around
+    uint8_t seq   = 0;
+    /// the heart rate in beats per minute
+    uint8_t hr    = 0;
+    /// sets `flag_link` on the wire if present
+    etl::optional<link_t> link = etl::nullopt;
+  };
+
+  /**
+   * @return the size of the frame; `size_needed()` is the smallest one
+   */
+  static constexpr size_t size_needed(bool with_link = false) {
+    // header + link + crc
+    return header_size + (with_link ? 2 * sizeof(int8_t) : 0) + sizeof(uint8_t);
+  }
+
+  static constexpr size_t size_needed(const t &data) {
+    return size_needed(data.link.has_value());
+  }
+
+  static size_t marshal(const t &data, uint8_t *buffer, size_t size) {
+    if (size < size_needed(data)) {
       return 0;
     }
-    buffer[0] = magic;
-    buffer[1] = data.key;
-    buffer[2] = data.hr;
-    return size_needed();
+    size_t offset    = 0;
+    buffer[offset++] = magic;
+    buffer[offset++] = data.link ? (data.flags | flag_link) : (data.flags & ~flag_link);
+    buffer[offset++] = data.key;
+    buffer[offset++] = data.seq;
+    buffer[offset++] = data.hr;
+    if (data.link) {
+      buffer[offset++] = static_cast<uint8_t>(data.link->ble_rssi);
+      buffer[offset++] = static_cast<uint8_t>(data.link->lora_snr);
+    }
+    buffer[offset] = crc8(buffer, offset);
+    return offset + 1;
   }
+
   static etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
-    if (size < size_needed()) {
+    if (size < size_needed() || buffer[0] != magic) {
       return etl::nullopt;
     }
-
     t data;
-    if (buffer[0] != magic) {
+    data.flags     = buffer[1];
+    data.key       = buffer[2];
+    data.seq       = buffer[3];
+    data.hr        = buffer[4];
+    bool with_link = data.flags & flag_link;
+    if (size < size_needed(with_link)) {
+      return etl::nullopt;
+    }
+    size_t offset = header_size;
+    if (with_link) {
+      data.link = link_t{
+          .ble_rssi = static_cast<int8_t>(buffer[offset]),
+          .lora_snr = static_cast<int8_t>(buffer[offset + 1]),
+      };
+      offset += 2;
+    }
+    if (buffer[offset] != crc8(buffer, offset)) {
       return etl::nullopt;
     }
-
-    data.key = buffer[1];
-    data.hr  = buffer[2];
-
     return data;
   }
 };
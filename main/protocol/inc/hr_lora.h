@@ -10,87 +10,178 @@
  *       don't include any other files in this directory
  */
 
+#include <array>
+#include <span>
+#include <utility>
+#include <variant>
 #include "hr_lora_common.tpp"
 #include "hr_data.tpp"
 #include "query_device_by_mac.tpp"
 #include "set_name_map_key.tpp"
+#include "beacon.tpp"
+#include "relay.tpp"
+#include "seq_tracker.tpp"
+#include "path_selector.tpp"
+#include "ack.tpp"
+#include "roster.tpp"
+#include "short_addr.tpp"
+#include "bundle.tpp"
+#include "redundancy.tpp"
+#include "load_control.tpp"
+#include "alarm.tpp"
+#include "hrv_summary.tpp"
+#include "aggregate.tpp"
+#include "diagnostics.tpp"
 
 namespace HrLoRa::hr_lora_msg {
-using t = std::variant<
-    hr_data::t,
-    query_device_by_mac::t,
-    query_device_by_mac_response::t,
-    set_name_map_key::t>;
-
-// https://en.cppreference.com/w/cpp/utility/variant/visit
-// helper constant for the visitor #3
-template <class>
-inline constexpr bool always_false_v = false;
-// helper type for the visitor #4
-template <class... Ts>
-struct overloaded : Ts... {
-  using Ts::operator()...;
-};
-// explicit deduction guide (not needed as of C++20)
-template <class... Ts>
-overloaded(Ts...) -> overloaded<Ts...>;
-
-size_t marshal(t &data, uint8_t *buffer, size_t size) {
-  return std::visit(overloaded{
-                        [buffer, size](hr_data::t &data) {
-                          return hr_data::marshal(data, buffer, size);
-                        },
-                        [buffer, size](query_device_by_mac::t &data) {
-                          return query_device_by_mac::marshal(data, buffer, size);
-                        },
-                        [buffer, size](query_device_by_mac_response::t &data) {
-                          return query_device_by_mac_response::marshal(data, buffer, size);
-                        },
-                        [buffer, size](set_name_map_key::t &data) {
-                          return set_name_map_key::marshal(data, buffer, size);
-                        },
-                    },
-                    data);
-}
-
-// https://stackoverflow.com/questions/55612759/alternative-to-using-namespace-as-template-parameter
-// https://caml.inria.fr/pub/docs/oreilly-book/html/book-ora132.html
-// However, namespace could be treated as a struct
+/**
+ * @brief a list of module structs
+ */
+template <typename... Ms>
+struct module_list {
 #if __cplusplus >= 202002L
-template <unmarshallable T>
-#else
-template <typename T>
+  static_assert((marshallable<Ms> && ...), "every message should be marshallable");
+  static_assert((unmarshallable<Ms> && ...), "every message should be unmarshallable");
 #endif
-etl::optional<t> unmarshal_helper(const uint8_t *buffer, size_t size) {
-  auto res = T::unmarshal(buffer, size);
-  if (res) {
-    return t{res.value()};
-  } else {
-    return etl::nullopt;
+  using variant_t              = std::variant<typename Ms::t...>;
+  static constexpr size_t size = sizeof...(Ms);
+
+  static consteval bool is_magic_unique() {
+    std::array<bool, 256> seen{};
+    for (uint8_t magic : {Ms::magic...}) {
+      if (seen[magic]) {
+        return false;
+      }
+      seen[magic] = true;
+    }
+    return true;
   }
+};
+
+/**
+ * @brief all the messages. A new message only needs to be added here.
+ */
+using modules = module_list<
+    hr_data,
+    hr_data_v2,
+    query_device_by_mac,
+    query_device_by_mac_response,
+    set_name_map_key,
+    beacon,
+    relay,
+    command,
+    ack,
+    roster,
+    lease_short_addr,
+    query_device_by_short,
+    query_device_by_short_response,
+    set_name_map_key_short,
+    bundle,
+    hr_data_redundant,
+    load_control,
+    hr_alarm,
+    hrv_summary,
+    hr_aggregate,
+    set_report_mode,
+    query_diagnostics,
+    diagnostics_response>;
+static_assert(modules::is_magic_unique(), "the magic of every message should be unique");
+
+using t = modules::variant_t;
+
+/**
+ * @brief a frame with a magic that is not in `modules`
+ */
+struct unknown_t {
+  uint8_t magic;
+};
+
+/**
+ * @brief a frame that could not be unmarshalled by the module of its magic
+ */
+struct malformed_t {
+  uint8_t magic;
+};
+
+/**
+ * @brief the function type of an entry in the dispatch table
+ */
+template <typename Handler>
+using entry_t = decltype(std::declval<Handler &>().on_error(unknown_t{}, std::span<const uint8_t>{})) (*)(Handler &, const uint8_t *, size_t);
+
+template <typename Handler, typename M>
+inline auto dispatch_entry(Handler &handler, const uint8_t *buffer, size_t size) {
+  auto frame = std::span<const uint8_t>{buffer, size};
+  auto r     = M::unmarshal(buffer, size);
+  if (!r) {
+    return handler.on_error(malformed_t{M::magic}, frame);
+  }
+  return handler.on_message(r.value(), frame);
+}
+
+template <typename Handler>
+inline auto dispatch_unknown(Handler &handler, const uint8_t *buffer, size_t size) {
+  return handler.on_error(unknown_t{buffer[0]}, std::span<const uint8_t>{buffer, size});
 }
 
-etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
+template <typename Handler, typename... Ms>
+consteval auto make_dispatch_table(module_list<Ms...>) {
+  std::array<entry_t<Handler>, 256> table{};
+  table.fill(&dispatch_unknown<Handler>);
+  ((table[Ms::magic] = &dispatch_entry<Handler, Ms>), ...);
+  return table;
+}
+
+/**
+ * @brief unmarshal the frame by its magic and pass it to the handler, with one indexed call
+ * @tparam Handler should have
+ *   - `on_message(const M::t &, std::span<const uint8_t> frame)` overloaded for every module `M` in `modules`,
+ *     so that a new message could not be left out
+ *   - `on_error(unknown_t, std::span<const uint8_t> frame)` and `on_error(malformed_t, std::span<const uint8_t> frame)`
+ *   and all of them should return the same type
+ * @note `frame` is the whole frame, including the magic
+ */
+template <typename Handler>
+inline auto dispatch(Handler &handler, const uint8_t *buffer, size_t size) {
+  static constexpr auto table = make_dispatch_table<Handler>(modules{});
   if (size < 1) {
-    return etl::nullopt;
+    return handler.on_error(unknown_t{0}, std::span<const uint8_t>{buffer, size});
   }
-  auto magic = buffer[0];
-  switch (magic) {
-    case hr_data::magic: {
-      return unmarshal_helper<hr_data>(buffer, size);
-    }
-    case query_device_by_mac::magic: {
-      return unmarshal_helper<query_device_by_mac>(buffer, size);
-    }
-    case query_device_by_mac_response::magic: {
-      return unmarshal_helper<query_device_by_mac_response>(buffer, size);
-    }
-    case set_name_map_key::magic: {
-      return unmarshal_helper<set_name_map_key>(buffer, size);
-    }
-    default:
-      return etl::nullopt;
+  return table[buffer[0]](handler, buffer, size);
+}
+
+namespace detail {
+struct to_variant {
+  template <typename T>
+  etl::optional<t> on_message(const T &data, std::span<const uint8_t>) {
+    return t{data};
+  }
+  template <typename E>
+  etl::optional<t> on_error(E, std::span<const uint8_t>) {
+    return etl::nullopt;
   }
+};
+
+using marshal_entry_t = size_t (*)(const t &, uint8_t *, size_t);
+
+template <typename... Ms>
+consteval auto make_marshal_table(module_list<Ms...>) {
+  return std::array<marshal_entry_t, sizeof...(Ms)>{
+      [](const t &data, uint8_t *buffer, size_t size) -> size_t {
+        return Ms::marshal(*std::get_if<typename Ms::t>(&data), buffer, size);
+      }...,
+  };
+}
+}
+
+inline size_t marshal(const t &data, uint8_t *buffer, size_t size) {
+  static constexpr auto table = detail::make_marshal_table(modules{});
+  return table[data.index()](data, buffer, size);
+}
+
+inline etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
+  auto handler = detail::to_variant{};
+  return dispatch(handler, buffer, size);
 }
 }
 
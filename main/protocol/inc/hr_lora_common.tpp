@@ -9,6 +9,7 @@
  * @brief some common *constant* definitions for HRLoRA
  */
 
+#include <array>
 #include <string>
 #include <etl/optional.h>
 
@@ -18,6 +19,41 @@ constexpr auto broadcast_addr = std::array<uint8_t, BLE_ADDR_SIZE>{0xff, 0xff, 0
 using name_map_key_t          = uint8_t;
 using addr_t                  = std::array<uint8_t, BLE_ADDR_SIZE>;
 
+/**
+ * @brief a short address leased by the hub, to replace `addr_t` in the compact control frames
+ * @sa lease_short_addr
+ */
+using short_addr_t                   = uint16_t;
+constexpr auto SHORT_ADDR_SIZE       = sizeof(short_addr_t);
+constexpr auto broadcast_short_addr  = short_addr_t{0xffff};
+constexpr auto unassigned_short_addr = short_addr_t{0x0000};
+
+/**
+ * @brief write the short address in big endian
+ */
+constexpr void write_short_addr(short_addr_t addr, uint8_t *buffer) {
+  buffer[0] = addr >> 8;
+  buffer[1] = addr & 0xff;
+}
+
+constexpr short_addr_t read_short_addr(const uint8_t *buffer) {
+  return (static_cast<short_addr_t>(buffer[0]) << 8) | buffer[1];
+}
+
+/**
+ * @brief CRC-8 with polynomial 0x07 (CRC-8/SMBUS), used as the per-frame integrity check
+ */
+constexpr uint8_t crc8(const uint8_t *data, size_t size) {
+  uint8_t crc = 0;
+  for (size_t i = 0; i < size; ++i) {
+    crc ^= data[i];
+    for (int j = 0; j < 8; ++j) {
+      crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07) : static_cast<uint8_t>(crc << 1);
+    }
+  }
+  return crc;
+}
+
 #if __cplusplus >= 202002L
 /**
  * @brief module struct is a struct that has a special struct `t`
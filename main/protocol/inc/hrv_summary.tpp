@@ -0,0 +1,54 @@
+#ifndef BLE_LORA_ADAPTER_HRV_SUMMARY_H
+#define BLE_LORA_ADAPTER_HRV_SUMMARY_H
+
+#include <string>
+#include <etl/optional.h>
+#include "hr_lora_common.tpp"
+#include "layout.tpp"
+
+namespace HrLoRa {
+/**
+ * @brief the heart rate variability computed by the repeater from the RR intervals
+ * @note sent periodically instead of the RR intervals themselves
+ */
+struct hrv_summary {
+  static constexpr uint8_t magic = 0x76;
+  struct t {
+    using module      = hrv_summary;
+    uint8_t key       = 0;
+    /// increased by one for each summary, wraps around
+    uint8_t seq       = 0;
+    /// the root mean square of the successive differences, in milliseconds
+    uint16_t rmssd_ms = 0;
+    /// the standard deviation of the RR intervals, in milliseconds
+    uint16_t sdnn_ms  = 0;
+    /// the mean of the RR intervals, in milliseconds
+    uint16_t mean_ms  = 0;
+    /// the number of the RR intervals used for `sdnn_ms`
+    uint8_t beats     = 0;
+    /// the RR intervals rejected as artifacts since the last summary, saturated at 255
+    uint8_t rejected  = 0;
+  };
+  using layout = fixed_layout<t,
+                              field::magic<magic>,
+                              field::key<&t::key>,
+                              field::u8<&t::seq>,
+                              field::u16<&t::rmssd_ms>,
+                              field::u16<&t::sdnn_ms>,
+                              field::u16<&t::mean_ms>,
+                              field::u8<&t::beats>,
+                              field::u8<&t::rejected>,
+                              field::crc8>;
+  static consteval size_t size_needed() {
+    return layout::size_needed();
+  }
+  static size_t marshal(const t &data, uint8_t *buffer, size_t size) {
+    return layout::marshal(data, buffer, size);
+  }
+  static etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
+    return layout::unmarshal(buffer, size);
+  }
+};
+}
+
+#endif // BLE_LORA_ADAPTER_HRV_SUMMARY_H
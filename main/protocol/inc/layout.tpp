@@ -0,0 +1,209 @@
+#ifndef BLE_LORA_ADAPTER_LAYOUT_H
+#define BLE_LORA_ADAPTER_LAYOUT_H
+
+/**
+ * @brief a compile-time description of the fixed-size messages
+ * @note a message lists its fields in wire order, e.g.
+ *
+ *       using layout = fixed_layout<t, field::magic<magic>, field::key<&t::key>, field::u8<&t::hr>>;
+ *
+ *       and `fixed_layout` provides `size_needed`, `marshal` and `unmarshal` with the offsets
+ *       computed at compile time and a single length check. `docs/gen.py` reads the same
+ *       declaration (and the `///` comments of the members of `t`) to emit the `.ksy` file,
+ *       so the field names of the descriptors below are part of that contract.
+ */
+
+#include <array>
+#include <utility>
+#include <type_traits>
+#include <etl/optional.h>
+#include "hr_lora_common.tpp"
+
+namespace HrLoRa {
+namespace field {
+template <typename>
+struct member_pointer_traits;
+
+template <typename C, typename M>
+struct member_pointer_traits<M C::*> {
+  using class_t  = C;
+  using member_t = M;
+};
+
+/**
+ * @brief a constant byte identifying the message
+ */
+template <uint8_t Magic>
+struct magic {
+  static constexpr size_t size = sizeof(uint8_t);
+  template <typename T>
+  static constexpr void write(const T &, uint8_t *buffer, size_t offset) {
+    buffer[offset] = Magic;
+  }
+  template <typename T>
+  static constexpr bool read(T &, const uint8_t *buffer, size_t offset) {
+    return buffer[offset] == Magic;
+  }
+};
+
+/**
+ * @brief a byte, or an enum with `uint8_t` as the underlying type
+ */
+template <auto Member>
+struct u8 {
+  using member_t               = typename member_pointer_traits<decltype(Member)>::member_t;
+  static constexpr size_t size = sizeof(uint8_t);
+  static_assert(sizeof(member_t) == size);
+  template <typename T>
+  static constexpr void write(const T &data, uint8_t *buffer, size_t offset) {
+    buffer[offset] = static_cast<uint8_t>(data.*Member);
+  }
+  template <typename T>
+  static constexpr bool read(T &data, const uint8_t *buffer, size_t offset) {
+    data.*Member = static_cast<member_t>(buffer[offset]);
+    return true;
+  }
+};
+
+/**
+ * @brief `name_map_key_t`
+ */
+template <auto Member>
+struct key : u8<Member> {};
+
+/**
+ * @brief a signed byte (`int8_t`)
+ */
+template <auto Member>
+struct i8 : u8<Member> {};
+
+/**
+ * @brief a big endian `uint16_t`
+ */
+template <auto Member>
+struct u16 {
+  using member_t               = typename member_pointer_traits<decltype(Member)>::member_t;
+  static constexpr size_t size = sizeof(uint16_t);
+  static_assert(sizeof(member_t) == size);
+  template <typename T>
+  static constexpr void write(const T &data, uint8_t *buffer, size_t offset) {
+    buffer[offset]     = data.*Member >> 8;
+    buffer[offset + 1] = data.*Member & 0xff;
+  }
+  template <typename T>
+  static constexpr bool read(T &data, const uint8_t *buffer, size_t offset) {
+    data.*Member = (static_cast<member_t>(buffer[offset]) << 8) | buffer[offset + 1];
+    return true;
+  }
+};
+
+/**
+ * @brief a big endian `int16_t` (two's complement)
+ */
+template <auto Member>
+struct i16 : u16<Member> {};
+
+/**
+ * @brief `short_addr_t`
+ */
+template <auto Member>
+struct short_addr : u16<Member> {};
+
+/**
+ * @brief a fixed-size byte array (e.g. `addr_t`)
+ */
+template <auto Member>
+struct bytes {
+  using member_t               = typename member_pointer_traits<decltype(Member)>::member_t;
+  static constexpr size_t size = std::tuple_size_v<member_t>;
+  template <typename T>
+  static constexpr void write(const T &data, uint8_t *buffer, size_t offset) {
+    for (size_t i = 0; i < size; ++i) {
+      buffer[offset + i] = (data.*Member)[i];
+    }
+  }
+  template <typename T>
+  static constexpr bool read(T &data, const uint8_t *buffer, size_t offset) {
+    for (size_t i = 0; i < size; ++i) {
+      (data.*Member)[i] = buffer[offset + i];
+    }
+    return true;
+  }
+};
+
+/**
+ * @brief the Bluetooth LE address (`addr_t`)
+ */
+template <auto Member>
+struct addr : bytes<Member> {};
+
+/**
+ * @brief `crc8` of all the preceding bytes. Should be the last field.
+ */
+struct crc8 {
+  static constexpr size_t size = sizeof(uint8_t);
+  template <typename T>
+  static constexpr void write(const T &, uint8_t *buffer, size_t offset) {
+    buffer[offset] = HrLoRa::crc8(buffer, offset);
+  }
+  template <typename T>
+  static constexpr bool read(T &, const uint8_t *buffer, size_t offset) {
+    return buffer[offset] == HrLoRa::crc8(buffer, offset);
+  }
+};
+}
+
+/**
+ * @tparam T the message type (i.e. `t` of a module struct)
+ * @tparam Fields the descriptors in `field`, in wire order
+ */
+template <typename T, typename... Fields>
+struct fixed_layout {
+  static constexpr auto offsets = [] {
+    std::array<size_t, sizeof...(Fields)> result{};
+    size_t i      = 0;
+    size_t offset = 0;
+    ((result[i++] = offset, offset += Fields::size), ...);
+    return result;
+  }();
+
+  static consteval size_t size_needed() {
+    return (Fields::size + ... + 0);
+  }
+
+  static size_t marshal(const T &data, uint8_t *buffer, size_t size) {
+    if (size < size_needed()) {
+      return 0;
+    }
+    write(data, buffer, std::index_sequence_for<Fields...>{});
+    return size_needed();
+  }
+
+  /**
+   * @note fails at the first field that could not be read (e.g. the magic or the CRC mismatches)
+   */
+  static etl::optional<T> unmarshal(const uint8_t *buffer, size_t size) {
+    if (size < size_needed()) {
+      return etl::nullopt;
+    }
+    T data;
+    if (!read(data, buffer, std::index_sequence_for<Fields...>{})) {
+      return etl::nullopt;
+    }
+    return data;
+  }
+
+private:
+  template <size_t... I>
+  static void write(const T &data, uint8_t *buffer, std::index_sequence<I...>) {
+    (Fields::write(data, buffer, offsets[I]), ...);
+  }
+
+  template <size_t... I>
+  static bool read(T &data, const uint8_t *buffer, std::index_sequence<I...>) {
+    return (Fields::read(data, buffer, offsets[I]) && ...);
+  }
+};
+}
+
+#endif // BLE_LORA_ADAPTER_LAYOUT_H
@@ -0,0 +1,44 @@
+#ifndef BLE_LORA_ADAPTER_LOAD_CONTROL_H
+#define BLE_LORA_ADAPTER_LOAD_CONTROL_H
+
+#include <string>
+#include <etl/optional.h>
+#include "hr_lora_common.tpp"
+#include "layout.tpp"
+
+namespace HrLoRa {
+/**
+ * @brief broadcast by the hub to slow the repeaters down when the channel saturates
+ * @note the hub is expected to resend it periodically (e.g. after each beacon)
+ *       while the congestion lasts, so that a repeater missing one frame, or
+ *       joining later, still catches up.
+ */
+struct load_control {
+  static constexpr uint8_t magic = 0x4d;
+  struct t {
+    using module            = load_control;
+    /// `broadcast_short_addr` for all the repeaters
+    short_addr_t short_addr = broadcast_short_addr;
+    /// the minimum interval between two `hr_data` from a repeater, in milliseconds. 0 for no limit.
+    uint16_t interval_ms    = 0;
+    /// the repeater falls back to no limit after this many seconds without another `load_control`. 0 for never.
+    uint8_t hold_s          = 0;
+  };
+  using layout = fixed_layout<t,
+                              field::magic<magic>,
+                              field::short_addr<&t::short_addr>,
+                              field::u16<&t::interval_ms>,
+                              field::u8<&t::hold_s>>;
+  static consteval size_t size_needed() {
+    return layout::size_needed();
+  }
+  static size_t marshal(const t &data, uint8_t *buffer, size_t size) {
+    return layout::marshal(data, buffer, size);
+  }
+  static etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
+    return layout::unmarshal(buffer, size);
+  }
+};
+}
+
+#endif // BLE_LORA_ADAPTER_LOAD_CONTROL_H
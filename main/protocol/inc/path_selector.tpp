@@ -0,0 +1,158 @@
+#ifndef BLE_LORA_ADAPTER_PATH_SELECTOR_H
+#define BLE_LORA_ADAPTER_PATH_SELECTOR_H
+
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <etl/optional.h>
+#include "hr_lora_common.tpp"
+#include "hr_data.tpp"
+#include "seq_tracker.tpp"
+
+namespace HrLoRa {
+/**
+ * @sa path_selector
+ */
+struct path_selector_config_t {
+  /// the RSSI in dBm where the BLE link starts to drop packets
+  int8_t ble_floor_dbm  = -90;
+  /// the SNR in 0.25 dB where the LoRa link starts to drop packets (-7.5 dB for SF7)
+  int8_t lora_floor_qdb = -30;
+  /// a new path has to be this much better (in dB) than the current one to take over
+  uint8_t hysteresis_db = 3;
+  /// the current path is given up if nothing is heard from it for this long
+  uint32_t stale_ms     = 5000;
+};
+
+/**
+ * @brief pick the best repeater for a heart rate monitor heard by several of them, on the hub side
+ * @tparam Groups the number of the heart rate monitors tracked. The caller maps a monitor to a group
+ *         (e.g. by the address in `query_device_by_short_response`). A group equal or larger than
+ *         `Groups` shares the entry of `group % Groups`.
+ * @tparam Paths the number of the repeaters tracked per group. The least recently heard one is replaced.
+ * @note the score of a path is its weaker link, i.e. the smaller margin above the floor of the BLE RSSI
+ *       and the LoRa SNR (see `hr_data_v2::link_t`). A frame without a link tag scores the floor.
+ *       The copies of a frame (e.g. relayed) are deduped by the sequence number of the origin key.
+ */
+template <size_t Groups = 64, size_t Paths = 4>
+class path_selector {
+public:
+  enum class verdict_t {
+    /// from the best path; should be delivered
+    deliver,
+    /// a copy of a frame seen before
+    duplicated,
+    /// from a path other than the best one
+    standby,
+  };
+
+private:
+  struct path_t {
+    name_map_key_t key    = 0;
+    /// in dB above the floor
+    int16_t score         = 0;
+    uint32_t last_seen_ms = 0;
+    bool valid            = false;
+  };
+  struct group_t {
+    std::array<path_t, Paths> paths{};
+    etl::optional<name_map_key_t> best = etl::nullopt;
+    uint32_t switches                  = 0;
+  };
+  std::array<group_t, Groups> groups{};
+  seq_tracker<> seqs{};
+  path_selector_config_t config;
+
+  [[nodiscard]] int16_t score_of(const etl::optional<hr_data_v2::link_t> &link) const {
+    constexpr auto missing = hr_data_v2::link_t::missing;
+    if (!link || link->ble_rssi == missing || link->lora_snr == missing) {
+      return 0;
+    }
+    const int16_t ble  = link->ble_rssi - config.ble_floor_dbm;
+    const int16_t lora = (link->lora_snr - config.lora_floor_qdb) / 4;
+    return std::min(ble, lora);
+  }
+
+  path_t &path_of(group_t &g, name_map_key_t key) {
+    auto it = std::find_if(g.paths.begin(), g.paths.end(), [key](const path_t &p) {
+      return p.valid && p.key == key;
+    });
+    if (it != g.paths.end()) {
+      return *it;
+    }
+    // an empty slot sorts first as its `last_seen_ms` is 0
+    auto &p = *std::min_element(g.paths.begin(), g.paths.end(), [](const path_t &a, const path_t &b) {
+      return !a.valid || (b.valid && a.last_seen_ms < b.last_seen_ms);
+    });
+    if (p.valid && g.best == p.key) {
+      g.best = etl::nullopt;
+    }
+    p = path_t{.key = key, .valid = true};
+    return p;
+  }
+
+  [[nodiscard]] const path_t *find(const group_t &g, name_map_key_t key) const {
+    for (const auto &p : g.paths) {
+      if (p.valid && p.key == key) {
+        return &p;
+      }
+    }
+    return nullptr;
+  }
+
+public:
+  explicit path_selector(path_selector_config_t config = {}) : config(config) {}
+
+  /**
+   * @param group the heart rate monitor
+   * @param now_ms a monotonic clock, wraps around
+   */
+  verdict_t on_frame(size_t group, const hr_data_v2::t &frame, uint32_t now_ms) {
+    auto &g = groups[group % Groups];
+    auto &p = path_of(g, frame.key);
+    if (seqs.update(frame.key, frame.seq) == seq_result_t::duplicated) {
+      return verdict_t::duplicated;
+    }
+    p.score        = score_of(frame.link);
+    p.last_seen_ms = now_ms;
+
+    const path_t *best = g.best ? find(g, *g.best) : nullptr;
+    if (best == nullptr || now_ms - best->last_seen_ms > config.stale_ms) {
+      best = nullptr;
+    }
+    if (best != &p && (best == nullptr || p.score >= best->score + config.hysteresis_db)) {
+      if (g.best) {
+        g.switches += 1;
+      }
+      g.best = p.key;
+    }
+    return g.best == p.key ? verdict_t::deliver : verdict_t::standby;
+  }
+
+  /**
+   * @return the key of the repeater whose frames are delivered for the group
+   */
+  [[nodiscard]] etl::optional<name_map_key_t> best(size_t group) const {
+    return groups[group % Groups].best;
+  }
+
+  /**
+   * @return the number of the handoffs of the group
+   */
+  [[nodiscard]] uint32_t switches(size_t group) const {
+    return groups[group % Groups].switches;
+  }
+
+  void reset(size_t group) {
+    auto &g = groups[group % Groups];
+    for (const auto &p : g.paths) {
+      if (p.valid) {
+        seqs.reset(p.key);
+      }
+    }
+    g = group_t{};
+  }
+};
+}
+
+#endif // BLE_LORA_ADAPTER_PATH_SELECTOR_H
@@ -6,54 +6,62 @@
 #define BLE_LORA_ADAPTER_QUERY_DEVICE_BY_MAC_H
 
 #include <string>
+#include <string_view>
+#include <algorithm>
 #include <etl/optional.h>
+#include <etl/string.h>
 #include "hr_lora_common.tpp"
+#include "layout.tpp"
 
 namespace HrLoRa {
+/**
+ * @brief sent by the hub to query a repeater by its Bluetooth LE address
+ */
 struct query_device_by_mac {
+  static constexpr uint8_t magic = 0x37;
   struct t {
     using module = query_device_by_mac;
+    /// `broadcast_addr` to query all the repeaters
     addr_t addr{};
   };
+  using layout = fixed_layout<t,
+                              field::magic<magic>,
+                              field::addr<&t::addr>>;
   static consteval size_t size_needed() {
-    return BLE_ADDR_SIZE + 1;
+    return layout::size_needed();
   }
-  static constexpr uint8_t magic = 0x37;
   static size_t marshal(const t &data, uint8_t *buffer, size_t size) {
-    if (size < size_needed()) {
-      return 0;
-    }
-    buffer[0] = magic;
-    for (int i = 0; i < BLE_ADDR_SIZE; ++i) {
-      buffer[i + 1] = data.addr[i];
-    }
-    return size_needed();
+    return layout::marshal(data, buffer, size);
   }
   static etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
-    if (size < size_needed()) {
-      return etl::nullopt;
-    }
-
-    t data;
-    if (buffer[0] != magic) {
-      return etl::nullopt;
-    }
-
-    for (int i = 0; i < BLE_ADDR_SIZE; ++i) {
-      data.addr[i] = buffer[i + 1];
-    }
-
-    return data;
+    return layout::unmarshal(buffer, size);
   }
 };
 
 struct hr_device {
+  /// the longer name is truncated
+  static constexpr size_t max_name_size = 31;
+  using name_t                          = etl::string<max_name_size>;
+
+  /**
+   * @brief the owned type, used to build a message without touching the heap
+   */
   struct t {
     using module = hr_device;
     addr_t addr{};
     // zero terminated string
-    std::string name{};
+    name_t name{};
   };
+
+  /**
+   * @brief the borrowed type, used to decode a message without copying
+   * @note `name` points into the receive buffer. The user should keep the buffer alive.
+   */
+  struct view_t {
+    addr_t addr{};
+    std::string_view name{};
+  };
+
   static size_t size_needed(const t &data) {
     return BLE_ADDR_SIZE + data.name.size() + 1;
   }
@@ -65,27 +73,36 @@ struct hr_device {
     for (int i = 0; i < BLE_ADDR_SIZE; ++i) {
       buffer[offset++] = data.addr[i];
     }
-    for (char i : data.name) {
-      buffer[offset++] = i;
-    }
+    std::copy(data.name.begin(), data.name.end(), buffer + offset);
+    offset += data.name.size();
     buffer[offset++] = 0;
     return offset;
   }
-  static etl::optional<t> unmarshal(const uint8_t *buffer, size_t buffer_size) {
+  static etl::optional<view_t> view(const uint8_t *buffer, size_t buffer_size) {
     if (buffer_size < BLE_ADDR_SIZE) {
       return etl::nullopt;
     }
 
+    view_t data;
+    std::copy(buffer, buffer + BLE_ADDR_SIZE, data.addr.begin());
+    auto name_begin = buffer + BLE_ADDR_SIZE;
+    auto name_end   = std::find(name_begin, buffer + buffer_size, 0);
+    data.name       = std::string_view{reinterpret_cast<const char *>(name_begin), static_cast<size_t>(name_end - name_begin)};
+    return data;
+  }
+  static t to_owned(const view_t &view) {
     t data;
-    for (int i = 0; i < BLE_ADDR_SIZE; ++i) {
-      data.addr[i] = buffer[i];
-    }
-    size_t offset = BLE_ADDR_SIZE;
-    while (offset < buffer_size && buffer[offset] != 0) {
-      data.name.push_back(buffer[offset++]);
-    }
+    data.addr = view.addr;
+    data.name.assign(view.name.data(), std::min(view.name.size(), max_name_size));
     return data;
   }
+  static etl::optional<t> unmarshal(const uint8_t *buffer, size_t buffer_size) {
+    auto v = view(buffer, buffer_size);
+    if (!v) {
+      return etl::nullopt;
+    }
+    return to_owned(*v);
+  }
 };
 
 struct query_device_by_mac_response {
@@ -96,10 +113,21 @@ struct query_device_by_mac_response {
     name_map_key_t key                 = 0;
     etl::optional<hr_device::t> device = etl::nullopt;
   };
+  /**
+   * @brief the borrowed counterpart of `t`
+   * @sa hr_device::view_t
+   */
+  struct view_t {
+    addr_t repeater_addr{};
+    name_map_key_t key                      = 0;
+    etl::optional<hr_device::view_t> device = etl::nullopt;
+  };
   static size_t size_needed(const t &data) {
+    // magic + repeater_addr + key + flag + device
     return sizeof(magic) +
            BLE_ADDR_SIZE +
            sizeof(t::key) +
+           sizeof(uint8_t) +
            (data.device ? hr_device::size_needed(*data.device) : 0);
   }
   static size_t marshal(const t &data, uint8_t *buffer, size_t size) {
@@ -123,12 +151,13 @@ struct query_device_by_mac_response {
     }
     return offset;
   }
-  static etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
-    if (size < BLE_ADDR_SIZE + sizeof(name_map_key_t)) {
+  static etl::optional<view_t> view(const uint8_t *buffer, size_t size) {
+    // magic + repeater_addr + key + flag
+    if (size < sizeof(magic) + BLE_ADDR_SIZE + sizeof(name_map_key_t) + sizeof(uint8_t)) {
       return etl::nullopt;
     }
 
-    t data;
+    view_t data;
     if (buffer[0] != magic) {
       return etl::nullopt;
     }
@@ -139,12 +168,25 @@ struct query_device_by_mac_response {
     data.key     = buffer[offset++];
     uint8_t flag = buffer[offset++];
     if (flag & 0x01) {
-      data.device = hr_device::unmarshal(buffer + offset, size - offset);
+      data.device = hr_device::view(buffer + offset, size - offset);
     } else {
       data.device = etl::nullopt;
     }
     return data;
   }
+  static etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
+    auto v = view(buffer, size);
+    if (!v) {
+      return etl::nullopt;
+    }
+    t data;
+    data.repeater_addr = v->repeater_addr;
+    data.key           = v->key;
+    if (v->device) {
+      data.device = hr_device::to_owned(*v->device);
+    }
+    return data;
+  }
 };
 }
 
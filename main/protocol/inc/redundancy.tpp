@@ -0,0 +1,216 @@
+#ifndef BLE_LORA_ADAPTER_REDUNDANCY_H
+#define BLE_LORA_ADAPTER_REDUNDANCY_H
+
+#include <array>
+#include <span>
+#include <algorithm>
+#include <cstdint>
+#include <etl/optional.h>
+#include "hr_lora_common.tpp"
+
+namespace HrLoRa {
+/**
+ * @brief `hr_data_v2` which also carries the last few samples as deltas,
+ *        so that the hub could recover a lost frame from the next one
+ * @note the number of the previous samples is fixed by the radio profile,
+ *       so the frame size is still fixed for a profile (i.e. implicit header works).
+ */
+struct hr_data_redundant {
+  static constexpr uint8_t magic      = 0x65;
+  static constexpr size_t max_history = 8;
+  /// the delta of a previous sample that the repeater doesn't have (e.g. right after boot)
+  static constexpr int8_t missing     = INT8_MIN;
+  /// magic + key + seq + hr + count
+  static constexpr size_t header_size = 5;
+  struct t {
+    using module = hr_data_redundant;
+    uint8_t key  = 0;
+    /// increased by one for each transmitted frame, wraps around
+    uint8_t seq  = 0;
+    uint8_t hr   = 0;
+    /**
+     * @brief `history[i]` is the heart rate of the frame `seq - 1 - i`
+     * @note only the first `count` entries are used
+     */
+    std::array<etl::optional<uint8_t>, max_history> history{};
+    uint8_t count = 0;
+  };
+
+  static constexpr size_t size_needed(uint8_t count) {
+    // header + deltas + crc
+    return header_size + count + sizeof(uint8_t);
+  }
+
+  static size_t size_needed(const t &data) {
+    return size_needed(data.count);
+  }
+
+  /**
+   * @note each sample is encoded as the delta to the next newer sample, clamped to
+   *       [-127, 127]. The clamped value is used as the reference for the older ones,
+   *       so the error doesn't accumulate.
+   */
+  static size_t marshal(const t &data, uint8_t *buffer, size_t size) {
+    if (data.count > max_history || size < size_needed(data)) {
+      return 0;
+    }
+    buffer[0]   = magic;
+    buffer[1]   = data.key;
+    buffer[2]   = data.seq;
+    buffer[3]   = data.hr;
+    buffer[4]   = data.count;
+    int16_t ref = data.hr;
+    for (size_t i = 0; i < data.count; ++i) {
+      auto &h = data.history[i];
+      if (!h) {
+        buffer[header_size + i] = static_cast<uint8_t>(missing);
+        continue;
+      }
+      int16_t delta = std::clamp<int16_t>(*h - ref, -INT8_MAX, INT8_MAX);
+      ref += delta;
+      buffer[header_size + i] = static_cast<uint8_t>(static_cast<int8_t>(delta));
+    }
+    auto crc_offset    = header_size + data.count;
+    buffer[crc_offset] = crc8(buffer, crc_offset);
+    return size_needed(data);
+  }
+
+  static etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
+    if (size < size_needed(0)) {
+      return etl::nullopt;
+    }
+    if (buffer[0] != magic) {
+      return etl::nullopt;
+    }
+    t data;
+    data.key   = buffer[1];
+    data.seq   = buffer[2];
+    data.hr    = buffer[3];
+    data.count = buffer[4];
+    if (data.count > max_history || size < size_needed(data)) {
+      return etl::nullopt;
+    }
+    auto crc_offset = header_size + data.count;
+    if (buffer[crc_offset] != crc8(buffer, crc_offset)) {
+      return etl::nullopt;
+    }
+    int16_t ref = data.hr;
+    for (size_t i = 0; i < data.count; ++i) {
+      auto delta = static_cast<int8_t>(buffer[header_size + i]);
+      if (delta == missing) {
+        data.history[i] = etl::nullopt;
+        continue;
+      }
+      ref             = std::clamp<int16_t>(ref + delta, 0, UINT8_MAX);
+      data.history[i] = static_cast<uint8_t>(ref);
+    }
+    return data;
+  }
+};
+
+/**
+ * @brief fill the gaps in the sequence numbers with the previous samples
+ *        carried by `hr_data_redundant`, on the hub side
+ * @tparam N the number of keys tracked. A key equal or larger than `N` shares the entry of `key % N`.
+ * @note a sample is emitted at most once, in the order of the sequence numbers
+ *       within a frame. A sample older than 32 frames is dropped.
+ * @note the history carried by the first frame of a key is older than the stream
+ *       and fills no gap, so it's neither emitted nor counted as recovered.
+ */
+template <size_t N = 256>
+class redundancy_reassembler {
+public:
+  struct sample_t {
+    uint8_t seq    = 0;
+    uint8_t hr     = 0;
+    /// missed by the primary stream and recovered from the history of a later frame
+    bool recovered = false;
+  };
+
+  struct stats_t {
+    uint32_t delivered = 0;
+    uint32_t recovered = 0;
+  };
+
+private:
+  struct entry_t {
+    uint8_t last_seq = 0;
+    /// bit `n` is set if `last_seq - n` has been emitted
+    uint32_t window  = 0;
+    bool valid       = false;
+    stats_t stats{};
+  };
+  std::array<entry_t, N> entries{};
+
+  /**
+   * @brief start the stream right before `seq`, i.e. every earlier sample counts as emitted
+   */
+  static void start(entry_t &e, uint8_t seq) {
+    e.valid    = true;
+    e.last_seq = seq - 1;
+    e.window   = ~0u;
+  }
+
+  /**
+   * @return true if the sample is not emitted before, and mark it as emitted
+   */
+  static bool mark(entry_t &e, uint8_t seq) {
+    uint8_t ahead = seq - e.last_seq;
+    if (ahead != 0 && ahead < 128) {
+      e.window   = ahead >= 32 ? 1 : ((e.window << ahead) | 1);
+      e.last_seq = seq;
+      return true;
+    }
+    uint8_t behind = e.last_seq - seq;
+    if (behind >= 32) {
+      return false;
+    }
+    uint32_t bit = 1u << behind;
+    if (e.window & bit) {
+      return false;
+    }
+    e.window |= bit;
+    return true;
+  }
+
+public:
+  /**
+   * @param out the samples not emitted before, oldest first
+   * @return the number of samples written into `out`
+   */
+  size_t on_frame(const hr_data_redundant::t &frame, std::span<sample_t> out) {
+    auto &e  = entries[frame.key % N];
+    size_t n = 0;
+    if (!e.valid) {
+      start(e, frame.seq);
+    }
+    // the oldest first, so the window is shifted by the current one last
+    for (size_t i = frame.count; i > 0 && n < out.size(); --i) {
+      auto &h = frame.history[i - 1];
+      if (!h) {
+        continue;
+      }
+      uint8_t seq = frame.seq - i;
+      if (mark(e, seq)) {
+        out[n++] = sample_t{.seq = seq, .hr = *h, .recovered = true};
+        e.stats.recovered += 1;
+      }
+    }
+    if (n < out.size() && mark(e, frame.seq)) {
+      out[n++] = sample_t{.seq = frame.seq, .hr = frame.hr, .recovered = false};
+      e.stats.delivered += 1;
+    }
+    return n;
+  }
+
+  [[nodiscard]] const stats_t &stats(name_map_key_t key) const {
+    return entries[key % N].stats;
+  }
+
+  void reset(name_map_key_t key) {
+    entries[key % N] = entry_t{};
+  }
+};
+}
+
+#endif // BLE_LORA_ADAPTER_REDUNDANCY_H
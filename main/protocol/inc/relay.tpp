@@ -0,0 +1,226 @@
+#ifndef BLE_LORA_ADAPTER_RELAY_H
+#define BLE_LORA_ADAPTER_RELAY_H
+
+#include <span>
+#include <algorithm>
+#include <string>
+#include <etl/optional.h>
+#include "hr_lora_common.tpp"
+#include "hr_data.tpp"
+#include "query_device_by_mac.tpp"
+#include "short_addr.tpp"
+#include "redundancy.tpp"
+#include "alarm.tpp"
+#include "hrv_summary.tpp"
+#include "aggregate.tpp"
+#include "diagnostics.tpp"
+
+namespace HrLoRa {
+/**
+ * @brief a frame from a distant repeater forwarded by another repeater
+ * @note the original repeater never sends this frame. A frame without this
+ *       envelope is treated as it has `max_hops` hops left.
+ */
+struct relay {
+  static constexpr uint8_t magic           = 0x5e;
+  static constexpr uint8_t max_hops        = 2;
+  static constexpr size_t max_payload_size = 64;
+  struct t {
+    using module = relay;
+    /**
+     * @brief remaining hops. A frame with ttl 0 should not be relayed again.
+     */
+    uint8_t ttl = 0;
+    /**
+     * @brief the relayed frame, starting with its own magic
+     * @note borrowed from the receive buffer. The user should keep the buffer alive.
+     */
+    std::span<const uint8_t> payload{};
+  };
+
+  /**
+   * @return whether the frame with the magic is an uplink frame that could be relayed
+   */
+  static constexpr bool is_relayable(uint8_t magic) {
+    return magic == hr_data::magic ||
+           magic == hr_data_v2::magic ||
+           magic == hr_data_redundant::magic ||
+           magic == hr_alarm::magic ||
+           magic == hrv_summary::magic ||
+           magic == hr_aggregate::magic ||
+           magic == query_device_by_mac_response::magic ||
+           magic == query_device_by_short_response::magic ||
+           magic == diagnostics_response::magic;
+  }
+
+  /**
+   * @brief get the key of the repeater who originally sent the frame
+   * @param frame a relayable frame (see `is_relayable`)
+   */
+  static etl::optional<name_map_key_t> origin_key(std::span<const uint8_t> frame) {
+    if (frame.empty()) {
+      return etl::nullopt;
+    }
+    switch (frame[0]) {
+      case hr_data::magic:
+        if (frame.size() < hr_data::size_needed()) {
+          return etl::nullopt;
+        }
+        return frame[1];
+      case hr_data_v2::magic:
+        if (frame.size() < hr_data_v2::size_needed()) {
+          return etl::nullopt;
+        }
+        return frame[2];
+      case hr_data_redundant::magic:
+        if (frame.size() < hr_data_redundant::size_needed(0)) {
+          return etl::nullopt;
+        }
+        return frame[1];
+      case hr_alarm::magic:
+        if (frame.size() < hr_alarm::size_needed()) {
+          return etl::nullopt;
+        }
+        return frame[1];
+      case hrv_summary::magic:
+        if (frame.size() < hrv_summary::size_needed()) {
+          return etl::nullopt;
+        }
+        return frame[1];
+      case hr_aggregate::magic:
+        if (frame.size() < hr_aggregate::size_needed()) {
+          return etl::nullopt;
+        }
+        return frame[1];
+      case query_device_by_mac_response::magic:
+        // magic + repeater_addr
+        if (frame.size() < 1 + BLE_ADDR_SIZE + sizeof(name_map_key_t)) {
+          return etl::nullopt;
+        }
+        return frame[1 + BLE_ADDR_SIZE];
+      case query_device_by_short_response::magic:
+        // magic + short_addr
+        if (frame.size() < 1 + SHORT_ADDR_SIZE + sizeof(name_map_key_t)) {
+          return etl::nullopt;
+        }
+        return frame[1 + SHORT_ADDR_SIZE];
+      case diagnostics_response::magic:
+        if (frame.size() < diagnostics_response::size_needed()) {
+          return etl::nullopt;
+        }
+        return frame[1 + SHORT_ADDR_SIZE];
+      default:
+        return etl::nullopt;
+    }
+  }
+
+  static size_t size_needed(const t &data) {
+    return sizeof(magic) + sizeof(t::ttl) + data.payload.size();
+  }
+
+  static size_t marshal(const t &data, uint8_t *buffer, size_t size) {
+    if (data.payload.empty() || data.payload.size() > max_payload_size) {
+      return 0;
+    }
+    if (size < size_needed(data)) {
+      return 0;
+    }
+    buffer[0] = magic;
+    buffer[1] = data.ttl;
+    std::copy(data.payload.begin(), data.payload.end(), buffer + 2);
+    return size_needed(data);
+  }
+
+  static etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
+    // magic + ttl + at least the magic of payload
+    if (size < 3) {
+      return etl::nullopt;
+    }
+    if (buffer[0] != magic) {
+      return etl::nullopt;
+    }
+    t data;
+    data.ttl     = buffer[1];
+    data.payload = std::span<const uint8_t>{buffer + 2, size - 2};
+    if (!is_relayable(data.payload[0])) {
+      return etl::nullopt;
+    }
+    return data;
+  }
+};
+
+/**
+ * @brief FNV-1a folded to 16 bits. Used to tell frames apart in `dedupe_cache`.
+ */
+constexpr uint16_t frame_tag(std::span<const uint8_t> frame) {
+  uint32_t hash = 2166136261u;
+  for (auto b : frame) {
+    hash ^= b;
+    hash *= 16777619u;
+  }
+  return static_cast<uint16_t>((hash >> 16) ^ (hash & 0xffff));
+}
+
+/**
+ * @brief the tag to dedupe a relayable frame together with its origin key
+ * @note the sequence number for `hr_data_v2`, `hr_data_redundant`, `hrv_summary` and `hr_aggregate`,
+ *       the `alarm_id` for `hr_alarm`, or the hash of the frame for the others
+ */
+constexpr uint16_t dedupe_tag(std::span<const uint8_t> frame) {
+  if (!frame.empty() && frame[0] == hr_data_v2::magic && frame.size() >= hr_data_v2::size_needed()) {
+    return frame[3];
+  }
+  if (!frame.empty() && frame[0] == hr_data_redundant::magic && frame.size() >= hr_data_redundant::size_needed(0)) {
+    return frame[2];
+  }
+  if (!frame.empty() && frame[0] == hr_alarm::magic && frame.size() >= hr_alarm::size_needed()) {
+    return frame[2];
+  }
+  if (!frame.empty() && frame[0] == hrv_summary::magic && frame.size() >= hrv_summary::size_needed()) {
+    return frame[2];
+  }
+  if (!frame.empty() && frame[0] == hr_aggregate::magic && frame.size() >= hr_aggregate::size_needed()) {
+    return frame[2];
+  }
+  return frame_tag(frame);
+}
+
+/**
+ * @brief a small fixed-size cache of recently seen (key, tag) pairs
+ * @tparam N the number of entries. The oldest entry is evicted when the cache is full.
+ */
+template <size_t N>
+class dedupe_cache {
+  struct entry_t {
+    name_map_key_t key = 0;
+    uint16_t tag       = 0;
+    uint32_t time_ms   = 0;
+    bool valid         = false;
+  };
+  std::array<entry_t, N> entries{};
+  size_t next = 0;
+
+public:
+  /**
+   * @brief check whether the (key, tag) pair has been seen in `ttl_ms`, and record it if not
+   * @return true if seen (i.e. a duplicate)
+   */
+  bool seen(name_map_key_t key, uint16_t tag, uint32_t now_ms, uint32_t ttl_ms) {
+    for (auto &e : entries) {
+      if (e.valid && e.key == key && e.tag == tag && now_ms - e.time_ms < ttl_ms) {
+        return true;
+      }
+    }
+    entries[next] = entry_t{
+        .key     = key,
+        .tag     = tag,
+        .time_ms = now_ms,
+        .valid   = true,
+    };
+    next = (next + 1) % N;
+    return false;
+  }
+};
+}
+
+#endif // BLE_LORA_ADAPTER_RELAY_H
@@ -0,0 +1,188 @@
+#ifndef BLE_LORA_ADAPTER_ROSTER_H
+#define BLE_LORA_ADAPTER_ROSTER_H
+
+#include <span>
+#include <algorithm>
+#include <string>
+#include <etl/optional.h>
+#include "hr_lora_common.tpp"
+
+namespace HrLoRa {
+/**
+ * @brief assign the name map keys to many repeaters in one frame
+ * @note a large roster is split into fragments. Each fragment is self-contained,
+ *       so a repeater only needs the fragment that contains its own entry and
+ *       nothing is reassembled.
+ */
+struct roster {
+  static constexpr uint8_t magic        = 0x52;
+  /// magic + fragment + addr_size
+  static constexpr size_t header_size   = 3;
+  static constexpr size_t max_fragments = 16;
+
+  /**
+   * @brief an entry used by the hub to build the roster
+   * @note only the first `addr_size` bytes of `addr` are used
+   */
+  struct entry_t {
+    addr_t addr{};
+    name_map_key_t key = 0;
+  };
+
+  struct entry_view_t {
+    std::span<const uint8_t> addr{};
+    name_map_key_t key = 0;
+  };
+
+  struct t {
+    using module       = roster;
+    uint8_t frag_index = 0;
+    uint8_t frag_count = 1;
+    /// the size of the address in each entry (`BLE_ADDR_SIZE` for the MAC address)
+    uint8_t addr_size  = BLE_ADDR_SIZE;
+    /**
+     * @brief the packed (addr, key) entries
+     * @note borrowed from the receive buffer. The user should keep the buffer alive.
+     */
+    std::span<const uint8_t> entries{};
+
+    [[nodiscard]] size_t entry_size() const {
+      return addr_size + sizeof(name_map_key_t);
+    }
+
+    [[nodiscard]] size_t size() const {
+      return entries.size() / entry_size();
+    }
+
+    /**
+     * @brief view the n-th entry without copying
+     */
+    [[nodiscard]] entry_view_t at(size_t n) const {
+      auto e = entries.subspan(n * entry_size(), entry_size());
+      return entry_view_t{
+          .addr = e.first(addr_size),
+          .key  = e[addr_size],
+      };
+    }
+
+    /**
+     * @brief find the position of the entry of the address in this fragment
+     * @note the repeaters in a fragment acknowledge it in the order of their positions
+     */
+    [[nodiscard]] etl::optional<size_t> index_of(std::span<const uint8_t> addr) const {
+      if (addr.size() != addr_size) {
+        return etl::nullopt;
+      }
+      for (size_t i = 0; i < size(); ++i) {
+        auto e = at(i);
+        if (std::equal(e.addr.begin(), e.addr.end(), addr.begin())) {
+          return i;
+        }
+      }
+      return etl::nullopt;
+    }
+
+    /**
+     * @brief find the entry of the address
+     */
+    [[nodiscard]] etl::optional<name_map_key_t> find(std::span<const uint8_t> addr) const {
+      auto i = index_of(addr);
+      if (!i) {
+        return etl::nullopt;
+      }
+      return at(*i).key;
+    }
+  };
+
+  /**
+   * @return whether the fragment fields fit in the header, i.e. `frag_index < frag_count <= max_fragments`
+   */
+  static constexpr bool is_valid_fragment(uint8_t frag_index, uint8_t frag_count) {
+    return frag_count != 0 && frag_count <= max_fragments && frag_index < frag_count;
+  }
+
+  /**
+   * @return how many entries could be packed in a frame of `frame_size` bytes
+   */
+  static constexpr size_t max_entries(uint8_t addr_size, size_t frame_size = 255) {
+    if (frame_size < header_size) {
+      return 0;
+    }
+    return (frame_size - header_size) / (addr_size + sizeof(name_map_key_t));
+  }
+
+  static size_t size_needed(const t &data) {
+    return header_size + data.entries.size();
+  }
+
+  static size_t marshal(const t &data, uint8_t *buffer, size_t size) {
+    if (data.addr_size == 0 || data.entries.size() % data.entry_size() != 0) {
+      return 0;
+    }
+    if (!is_valid_fragment(data.frag_index, data.frag_count)) {
+      return 0;
+    }
+    if (size < size_needed(data)) {
+      return 0;
+    }
+    buffer[0] = magic;
+    buffer[1] = (data.frag_index << 4) | ((data.frag_count - 1) & 0x0f);
+    buffer[2] = data.addr_size;
+    std::copy(data.entries.begin(), data.entries.end(), buffer + header_size);
+    return size_needed(data);
+  }
+
+  /**
+   * @brief pack the entries into one fragment of the roster, on the hub side
+   * @param entries the entries in this fragment. See `max_entries`.
+   * @return the size of the frame, 0 if the buffer is too small or the fragment is out of range
+   */
+  static size_t marshal_fragment(std::span<const entry_t> entries, uint8_t addr_size,
+                                 uint8_t frag_index, uint8_t frag_count,
+                                 uint8_t *buffer, size_t size) {
+    const auto entry_size = addr_size + sizeof(name_map_key_t);
+    if (addr_size == 0 || addr_size > BLE_ADDR_SIZE || !is_valid_fragment(frag_index, frag_count)) {
+      return 0;
+    }
+    const auto needed = header_size + entries.size() * entry_size;
+    if (size < needed) {
+      return 0;
+    }
+    buffer[0]     = magic;
+    buffer[1]     = (frag_index << 4) | ((frag_count - 1) & 0x0f);
+    buffer[2]     = addr_size;
+    size_t offset = header_size;
+    for (const auto &e : entries) {
+      std::copy(e.addr.begin(), e.addr.begin() + addr_size, buffer + offset);
+      offset += addr_size;
+      buffer[offset++] = e.key;
+    }
+    return offset;
+  }
+
+  static etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
+    if (size < header_size) {
+      return etl::nullopt;
+    }
+    if (buffer[0] != magic) {
+      return etl::nullopt;
+    }
+    t data;
+    data.frag_index = buffer[1] >> 4;
+    data.frag_count = (buffer[1] & 0x0f) + 1;
+    data.addr_size  = buffer[2];
+    if (data.addr_size == 0 || data.addr_size > BLE_ADDR_SIZE) {
+      return etl::nullopt;
+    }
+    if (!is_valid_fragment(data.frag_index, data.frag_count)) {
+      return etl::nullopt;
+    }
+    // ignore the trailing bytes of an incomplete entry
+    auto entries_size = (size - header_size) / data.entry_size() * data.entry_size();
+    data.entries      = std::span<const uint8_t>{buffer + header_size, entries_size};
+    return data;
+  }
+};
+}
+
+#endif // BLE_LORA_ADAPTER_ROSTER_H
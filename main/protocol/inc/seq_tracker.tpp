@@ -0,0 +1,102 @@
+#ifndef BLE_LORA_ADAPTER_SEQ_TRACKER_H
+#define BLE_LORA_ADAPTER_SEQ_TRACKER_H
+
+#include <array>
+#include "hr_lora_common.tpp"
+
+namespace HrLoRa {
+/**
+ * @brief per-key counters derived from the rolling sequence number of `hr_data_v2`
+ * @note a sequence number is considered newer if it is at most 127 ahead of the last one.
+ *       A 32-entry bitmap of the recent sequence numbers tells late arrivals from duplicates.
+ */
+struct seq_stats_t {
+  uint32_t received   = 0;
+  /// the gaps in the sequence numbers. A late arrival fills a gap and decreases it.
+  uint32_t lost       = 0;
+  uint32_t duplicated = 0;
+  uint32_t reordered  = 0;
+  uint8_t last_seq    = 0;
+  /// bit `n` is set if `last_seq - n` has been received
+  uint32_t window     = 0;
+  bool valid          = false;
+
+  /**
+   * @return packet delivery ratio in permille, or 1000 if nothing is expected yet
+   */
+  [[nodiscard]] constexpr uint32_t pdr_permille() const {
+    auto expected = received + lost;
+    if (expected == 0) {
+      return 1000;
+    }
+    return static_cast<uint32_t>(static_cast<uint64_t>(received) * 1000 / expected);
+  }
+};
+
+enum class seq_result_t {
+  /// newer than any received one (possibly with a gap)
+  in_order,
+  /// older than the last one, but not seen before
+  reordered,
+  duplicated,
+};
+
+/**
+ * @brief track the sequence numbers of every key
+ * @tparam N the number of keys tracked. A key equal or larger than `N` shares the entry of `key % N`.
+ */
+template <size_t N = 256>
+class seq_tracker {
+  std::array<seq_stats_t, N> _stats{};
+
+public:
+  seq_result_t update(name_map_key_t key, uint8_t seq) {
+    auto &s = _stats[key % N];
+    if (!s.valid) {
+      s.valid    = true;
+      s.last_seq = seq;
+      s.window   = 1;
+      s.received += 1;
+      return seq_result_t::in_order;
+    }
+    uint8_t ahead = seq - s.last_seq;
+    if (ahead == 0) {
+      s.duplicated += 1;
+      return seq_result_t::duplicated;
+    }
+    if (ahead < 128) {
+      s.lost += ahead - 1;
+      s.window = ahead >= 32 ? 1 : ((s.window << ahead) | 1);
+      s.last_seq = seq;
+      s.received += 1;
+      return seq_result_t::in_order;
+    }
+    uint8_t behind = s.last_seq - seq;
+    if (behind < 32) {
+      uint32_t bit = 1u << behind;
+      if (s.window & bit) {
+        s.duplicated += 1;
+        return seq_result_t::duplicated;
+      }
+      s.window |= bit;
+    }
+    // too old to tell from the window; count it as a late arrival
+    s.reordered += 1;
+    s.received += 1;
+    if (s.lost > 0) {
+      s.lost -= 1;
+    }
+    return seq_result_t::reordered;
+  }
+
+  [[nodiscard]] const seq_stats_t &stats(name_map_key_t key) const {
+    return _stats[key % N];
+  }
+
+  void reset(name_map_key_t key) {
+    _stats[key % N] = seq_stats_t{};
+  }
+};
+}
+
+#endif // BLE_LORA_ADAPTER_SEQ_TRACKER_H
@@ -8,46 +8,33 @@
 #include <string>
 #include <etl/optional.h>
 #include "hr_lora_common.tpp"
+#include "layout.tpp"
 
 namespace HrLoRa {
+/**
+ * @brief sent by the hub to set the key which represents the name of the device
+ *        in `hr_data`, in order to reduce the size of the message
+ */
 struct set_name_map_key {
   static constexpr uint8_t magic = 0x79;
   struct t {
     using module = set_name_map_key;
+    /// the broadcast address is illegal for this command
     addr_t addr{};
     name_map_key_t key = 0;
   };
+  using layout = fixed_layout<t,
+                              field::magic<magic>,
+                              field::addr<&t::addr>,
+                              field::key<&t::key>>;
   static consteval size_t size_needed() {
-    // addr + key + magic
-    return BLE_ADDR_SIZE + sizeof(t::key) + sizeof(magic);
+    return layout::size_needed();
   }
-  static size_t marshal(const t &data, uint8_t *buffer, size_t buffer_size) {
-    if (buffer_size < size_needed()) {
-      return 0;
-    }
-    buffer[0] = magic;
-    for (int i = 0; i < BLE_ADDR_SIZE; ++i) {
-      buffer[i + 1] = data.addr[i];
-    }
-    buffer[BLE_ADDR_SIZE + 1] = data.key;
-    return size_needed();
+  static size_t marshal(const t &data, uint8_t *buffer, size_t size) {
+    return layout::marshal(data, buffer, size);
   }
   static etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
-    if (size < size_needed()) {
-      return etl::nullopt;
-    }
-
-    t data;
-    if (buffer[0] != magic) {
-      return etl::nullopt;
-    }
-
-    for (int i = 0; i < BLE_ADDR_SIZE; ++i) {
-      data.addr[i] = buffer[i + 1];
-    }
-    data.key = buffer[BLE_ADDR_SIZE + 1];
-
-    return data;
+    return layout::unmarshal(buffer, size);
   }
 };
 }
@@ -0,0 +1,172 @@
+#ifndef BLE_LORA_ADAPTER_SHORT_ADDR_H
+#define BLE_LORA_ADAPTER_SHORT_ADDR_H
+
+#include <string>
+#include <etl/optional.h>
+#include "hr_lora_common.tpp"
+#include "query_device_by_mac.tpp"
+#include "layout.tpp"
+
+namespace HrLoRa {
+/**
+ * @brief assign a short address to a repeater, which replaces the 6-byte
+ *        Bluetooth LE address in the compact control frames
+ * @note the MAC based frames are kept for bootstrapping (i.e. before a lease)
+ */
+struct lease_short_addr {
+  static constexpr uint8_t magic = 0x4c;
+  struct t {
+    using module = lease_short_addr;
+    /// the broadcast address is illegal for this command
+    addr_t addr{};
+    /// `broadcast_short_addr` is illegal for this command
+    short_addr_t short_addr = unassigned_short_addr;
+  };
+  using layout = fixed_layout<t,
+                              field::magic<magic>,
+                              field::addr<&t::addr>,
+                              field::short_addr<&t::short_addr>>;
+  static consteval size_t size_needed() {
+    return layout::size_needed();
+  }
+  static size_t marshal(const t &data, uint8_t *buffer, size_t size) {
+    return layout::marshal(data, buffer, size);
+  }
+  static etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
+    return layout::unmarshal(buffer, size);
+  }
+};
+
+/**
+ * @brief `query_device_by_mac` with the short address
+ */
+struct query_device_by_short {
+  static constexpr uint8_t magic = 0x38;
+  struct t {
+    using module = query_device_by_short;
+    /// `broadcast_short_addr` to query all the repeaters
+    short_addr_t short_addr = broadcast_short_addr;
+  };
+  using layout = fixed_layout<t,
+                              field::magic<magic>,
+                              field::short_addr<&t::short_addr>>;
+  static consteval size_t size_needed() {
+    return layout::size_needed();
+  }
+  static size_t marshal(const t &data, uint8_t *buffer, size_t size) {
+    return layout::marshal(data, buffer, size);
+  }
+  static etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
+    return layout::unmarshal(buffer, size);
+  }
+};
+
+/**
+ * @brief `query_device_by_mac_response` with the short address of the repeater
+ */
+struct query_device_by_short_response {
+  static constexpr uint8_t magic = 0x48;
+  struct t {
+    using module                       = query_device_by_short_response;
+    short_addr_t short_addr            = unassigned_short_addr;
+    name_map_key_t key                 = 0;
+    etl::optional<hr_device::t> device = etl::nullopt;
+  };
+  /**
+   * @brief the borrowed counterpart of `t`
+   * @sa hr_device::view_t
+   */
+  struct view_t {
+    short_addr_t short_addr                 = unassigned_short_addr;
+    name_map_key_t key                      = 0;
+    etl::optional<hr_device::view_t> device = etl::nullopt;
+  };
+  static size_t size_needed(const t &data) {
+    // magic + short_addr + key + flag + device
+    return sizeof(magic) +
+           SHORT_ADDR_SIZE +
+           sizeof(t::key) +
+           sizeof(uint8_t) +
+           (data.device ? hr_device::size_needed(*data.device) : 0);
+  }
+  static size_t marshal(const t &data, uint8_t *buffer, size_t size) {
+    if (size < size_needed(data)) {
+      return 0;
+    }
+    size_t offset    = 0;
+    buffer[offset++] = magic;
+    write_short_addr(data.short_addr, buffer + offset);
+    offset += SHORT_ADDR_SIZE;
+    buffer[offset++] = data.key;
+    // last bit indicates whether there is a device
+    buffer[offset++] = data.device ? 0x01 : 0x00;
+    if (data.device) {
+      offset += hr_device::marshal(*data.device, buffer + offset, size - offset);
+    }
+    return offset;
+  }
+  static etl::optional<view_t> view(const uint8_t *buffer, size_t size) {
+    // magic + short_addr + key + flag
+    if (size < sizeof(magic) + SHORT_ADDR_SIZE + sizeof(name_map_key_t) + sizeof(uint8_t)) {
+      return etl::nullopt;
+    }
+
+    view_t data;
+    if (buffer[0] != magic) {
+      return etl::nullopt;
+    }
+    size_t offset   = 1;
+    data.short_addr = read_short_addr(buffer + offset);
+    offset += SHORT_ADDR_SIZE;
+    data.key     = buffer[offset++];
+    uint8_t flag = buffer[offset++];
+    if (flag & 0x01) {
+      data.device = hr_device::view(buffer + offset, size - offset);
+    } else {
+      data.device = etl::nullopt;
+    }
+    return data;
+  }
+  static etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
+    auto v = view(buffer, size);
+    if (!v) {
+      return etl::nullopt;
+    }
+    t data;
+    data.short_addr = v->short_addr;
+    data.key        = v->key;
+    if (v->device) {
+      data.device = hr_device::to_owned(*v->device);
+    }
+    return data;
+  }
+};
+
+/**
+ * @brief `set_name_map_key` with the short address
+ */
+struct set_name_map_key_short {
+  static constexpr uint8_t magic = 0x7a;
+  struct t {
+    using module            = set_name_map_key_short;
+    /// `broadcast_short_addr` is illegal for this command
+    short_addr_t short_addr = unassigned_short_addr;
+    name_map_key_t key      = 0;
+  };
+  using layout = fixed_layout<t,
+                              field::magic<magic>,
+                              field::short_addr<&t::short_addr>,
+                              field::key<&t::key>>;
+  static consteval size_t size_needed() {
+    return layout::size_needed();
+  }
+  static size_t marshal(const t &data, uint8_t *buffer, size_t size) {
+    return layout::marshal(data, buffer, size);
+  }
+  static etl::optional<t> unmarshal(const uint8_t *buffer, size_t size) {
+    return layout::unmarshal(buffer, size);
+  }
+};
+}
+
+#endif // BLE_LORA_ADAPTER_SHORT_ADDR_H
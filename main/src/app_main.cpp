@@ -4,119 +4,567 @@
 #include "scan_manager.h"
 #include "server_callback.h"
 #include "whitelist_char_callback.h"
+#include "diagnostics_char_callback.h"
 #include "esp_hal.h"
 #include "common.h"
 #include "hr_lora.h"
 #include "app_nvs.h"
+#include "tdma.h"
+#include "radio_profile.h"
+#include "mesh_relay.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "hrv.h"
+#include "rx_pool.h"
+#include "radio_metrics.h"
+#include "power.h"
 #include <endian.h>
 #include <freertos/event_groups.h>
+#include <freertos/queue.h>
+#include <esp_random.h>
 #include <cstring>
+#include <cinttypes>
+#include <concepts>
 
 extern "C" void app_main();
 
+// `RecvEvt`, `SlotEvt`, `AlarmEvt`, `TxEvt` and `RxWinEvt` are the notification bits of the radio task
+// (see `notify_radio`); `RelayEvt` and `ParseEvt` are the bits of the event group of the parser task.
+
+/// DIO1, i.e. a packet is received (or a transmission is done)
 const auto RecvEvt = BIT0;
+/// the TDMA slot of this repeater begins
+const auto SlotEvt = BIT1;
+/// a relay of a frame from other repeater is due
+const auto RelayEvt = BIT2;
+/// an `HrLoRa::hr_alarm` is waiting, which goes before anything else
+const auto AlarmEvt = BIT3;
+/// a received packet is waiting for the parser task
+const auto ParseEvt = BIT4;
+/// a frame is waiting for the radio task to transmit
+const auto TxEvt    = BIT5;
+/// a receive window opens or closes (see `tdma::RxWindows`)
+const auto RxWinEvt = BIT6;
+
+/**
+ * @brief the argument of the DIO1 ISR, one for each radio
+ */
+struct dio1_ctx_t {
+  gpio_num_t pin;
+  /// the radio task, notified with `RecvEvt`. Set once the task runs.
+  TaskHandle_t task;
+  /// the time of the last DIO1 interrupt (`esp_timer_get_time`) of a received packet, used as the TDMA anchor
+  int64_t rx_time_us;
+  /// set by the radio task while transmitting (or scanning the channel), whose DIO1 (TX_DONE, CAD_DONE)
+  /// is not a received packet and must not move the anchor
+  volatile bool transmitting;
+};
+
+/**
+ * @note notifies the radio task directly, instead of `xEventGroupSetBitsFromISR`,
+ *       which defers to the FreeRTOS timer task (at a low priority)
+ */
+static void IRAM_ATTR on_dio1(dio1_ctx_t *ctx) {
+  if (!ctx->transmitting) {
+    ctx->rx_time_us = esp_timer_get_time();
+  }
+  // unmasked by the radio task once the IRQ is cleared (see `power::enable_wakeup`)
+  power::mask(ctx->pin);
+  BaseType_t task_woken = pdFALSE;
+  if (ctx->task != nullptr) {
+    xTaskNotifyFromISR(ctx->task, RecvEvt, eSetBits, &task_woken);
+  }
+  portYIELD_FROM_ISR(task_woken);
+}
+
+/**
+ * @brief registered with `gpio_isr_handler_add` as the argument of `on_dio1`,
+ *        instead of `rf.setPacketReceivedAction` (whose callback takes no argument)
+ */
+static auto dio1_ctx = dio1_ctx_t{.pin = common::pin::DIO1, .task = nullptr, .rx_time_us = 0, .transmitting = false};
 
 /**
  * @brief try to transmit the data
+ * @param is_telemetry whether the data is a fixed-size telemetry frame (i.e. `hr_data`),
+ *        which might be sent in implicit header mode depending on the radio profile
  * @note would block until the transmission is done and will start receiving after that
  */
-void tryTransmit(uint8_t *data, size_t size, LLCC68 &rf) {
-  const auto TAG = "tryTransmit";
-  auto err       = rf.transmit(data, size);
+void tryTransmit(uint8_t *data, size_t size, LLCC68 &rf, bool is_telemetry = false) {
+  const auto TAG  = "tryTransmit";
+  const auto &pfl = radio::active_profile;
+  auto pm         = power::LockGuard(power::radio_tx);
+  if (is_telemetry) {
+    rf.standby();
+    radio::telemetry_mode(rf, pfl, size);
+  }
+  dio1_ctx.transmitting = true;
+  const auto start      = esp_timer_get_time();
+  auto err              = rf.transmit(data, size);
   if (err == RADIOLIB_ERR_NONE) {
-    // ok
+    radio::metrics.on_tx_done(esp_timer_get_time() - start, false);
   } else if (err == RADIOLIB_ERR_TX_TIMEOUT) {
+    radio::metrics.on_tx_done(esp_timer_get_time() - start, true);
     ESP_LOGW(TAG, "tx timeout; please check the busy pin;");
   } else {
     ESP_LOGE(TAG, "failed to transmit, code %d", err);
   }
   rf.standby();
-  rf.startReceive();
+  dio1_ctx.transmitting = false;
+  if (is_telemetry) {
+    radio::control_mode(rf, pfl);
+  }
+  radio::start_receive(rf, pfl);
 }
 
-struct handle_message_callbacks_t {
-  std::function<void(uint8_t *data, size_t size)> send          = nullptr;
-  std::function<etl::optional<blue::HeartMonitor>()> get_device = nullptr;
-  std::function<void(HrLoRa::name_map_key_t)> set_name_map_key  = nullptr;
-  std::function<HrLoRa::name_map_key_t()> get_name_map_key      = nullptr;
+/**
+ * @brief transmit the data once the channel is free (CAD), out of the TDMA slot
+ * @note sent anyway after `common::ALARM_MAX_ATTEMPTS` busy channels, with a random
+ *       backoff in between. Would block until the transmission is done.
+ */
+void transmitUrgent(uint8_t *data, size_t size, LLCC68 &rf) {
+  const auto TAG = "transmitUrgent";
+  auto pm        = power::LockGuard(power::radio_tx);
+  for (int i = 0; i < common::ALARM_MAX_ATTEMPTS; ++i) {
+    rf.standby();
+    dio1_ctx.transmitting = true;
+    auto st               = rf.scanChannel();
+    rf.standby();
+    dio1_ctx.transmitting = false;
+    if (st == RADIOLIB_CHANNEL_FREE) {
+      break;
+    }
+    // either a preamble is detected or the scan failed
+    const uint32_t backoff_ms = esp_random() % (common::ALARM_MAX_BACKOFF.count() + 1);
+    ESP_LOGD(TAG, "channel not free (code %d); retry in %" PRIu32 "ms", st, backoff_ms);
+    radio::start_receive(rf, radio::active_profile);
+    vTaskDelay(pdMS_TO_TICKS(backoff_ms));
+  }
+  tryTransmit(data, size, rf);
+}
+
+/**
+ * @brief the actions of the repeater used by `handle_message`
+ * @note bound at compile time, as a type with static member functions
+ */
+template <typename T>
+concept handle_message_callbacks = requires(uint8_t *data, const uint8_t *cdata, size_t size, etl::optional<uint8_t> rank,
+                                            HrLoRa::name_map_key_t key, HrLoRa::short_addr_t short_addr,
+                                            const HrLoRa::beacon::t &beacon, const HrLoRa::load_control::t &load,
+                                            const HrLoRa::set_report_mode::t &mode) {
+  { T::send(data, size) } -> std::same_as<void>;
+  /// staggered by `rank` among the repeaters answering the same frame
+  { T::send(data, size, rank) } -> std::same_as<void>;
+  /// the heart rate monitor connected to this repeater
+  { T::get_device() } -> std::convertible_to<etl::optional<HrLoRa::hr_device::t>>;
+  { T::set_name_map_key(key) } -> std::same_as<void>;
+  { T::get_name_map_key() } -> std::convertible_to<HrLoRa::name_map_key_t>;
+  { T::set_short_addr(short_addr) } -> std::same_as<void>;
+  { T::get_short_addr() } -> std::convertible_to<HrLoRa::short_addr_t>;
+  /// the radio link metrics. `short_addr` and `key` are filled by the handler.
+  { T::get_diagnostics() } -> std::convertible_to<HrLoRa::diagnostics_response::t>;
+  { T::on_beacon(beacon) } -> std::same_as<void>;
+  /// addressed to this repeater (or broadcast)
+  { T::on_load_control(load) } -> std::same_as<void>;
+  /// addressed to this repeater (or broadcast)
+  { T::on_report_mode(mode) } -> std::same_as<void>;
+  /// a frame from other repeater, either direct or relayed
+  { T::on_overheard(cdata, size) } -> std::same_as<void>;
 };
 
 /**
- * @brief handle the message received from LoRa
- * @param data the data received
- * @param size the size of the data
- * @param callbacks the callbacks to handle the message. This function would do nothing if any of the callback is empty.
+ * @brief the response to the payload of a `HrLoRa::command`, held back to be cached
+ *        and sent together with the `ack`
  */
-void handle_message(uint8_t *data, size_t size, const handle_message_callbacks_t &callbacks) {
-  const auto TAG   = "recv";
-  bool is_cb_empty = callbacks.send == nullptr ||
-                     callbacks.get_device == nullptr ||
-                     callbacks.set_name_map_key == nullptr ||
-                     callbacks.get_name_map_key == nullptr;
-  if (is_cb_empty) {
-    ESP_LOGE(TAG, "at least one callback is empty");
-    return;
-  }
-  auto magic = data[0];
-  switch (magic) {
-    case HrLoRa::query_device_by_mac::magic: {
-      auto r = HrLoRa::query_device_by_mac::unmarshal(data, size);
-      if (!r) {
-        ESP_LOGE(TAG, "failed to unmarshal query_device_by_mac");
-        break;
-      }
-      auto &req           = r.value();
-      auto my_addr        = NimBLEDevice::getAddress();
-      auto my_addr_native = my_addr.getNative();
-      bool is_broadcast   = std::equal(req.addr.begin(), req.addr.end(), HrLoRa::broadcast_addr.data());
-      bool eq             = is_broadcast || std::equal(req.addr.begin(), req.addr.end(), my_addr_native);
-      if (!eq) {
-        ESP_LOGI(TAG, "%s is not for me", utils::toHex(req.addr.data(), req.addr.size()).c_str());
-        break;
+struct command_response_t {
+  uint8_t buf[HrLoRa::command::max_response_size];
+  size_t size = 0;
+  /// see `HrLoRa::command_cache::cached_t::rank`
+  etl::optional<uint8_t> rank{};
+};
+
+enum class handle_result_t {
+  /// not for this repeater, malformed, or nothing to acknowledge
+  ignored,
+  ok,
+  /// applied but something went wrong (e.g. failed to persist)
+  failed,
+};
+
+/**
+ * @brief the `cmd_id` of the recently handled `HrLoRa::command`
+ */
+static auto handled_commands = HrLoRa::command_cache<common::COMMAND_CACHE_SIZE>{};
+
+template <handle_message_callbacks Callbacks>
+handle_result_t handle_message(const uint8_t *data, size_t size, command_response_t *response = nullptr, uint8_t depth = 0);
+
+/**
+ * @brief the handler of `HrLoRa::hr_lora_msg::dispatch`. One `on_message` for each message.
+ */
+template <handle_message_callbacks Callbacks>
+class MessageHandler {
+  static constexpr auto TAG = "recv";
+  NimBLEAddress my_addr     = NimBLEDevice::getAddress();
+  const uint8_t *my_addr_native;
+  command_response_t *response;
+  /// the envelopes (`command` or `bundle`) around the message being handled
+  uint8_t depth;
+  /**
+   * @brief e.g. a `bundle` of `command`s, but not a `command` in a `bundle` in a `command`
+   * @note each envelope takes a few hundred bytes of the stack of the parser task,
+   *       which a crafted frame could otherwise nest until it overflows
+   */
+  static constexpr uint8_t max_depth = 1;
+
+  /**
+   * @brief answer the hub, or hold the response back if handling the payload of a command
+   */
+  void reply(uint8_t *data, size_t size) {
+    if (response != nullptr && response->size == 0 && size <= sizeof(response->buf)) {
+      std::copy(data, data + size, response->buf);
+      response->size = size;
+      return;
+    }
+    Callbacks::send(data, size);
+  }
+
+  /**
+   * @brief apply and persist the name map key
+   * @note the flash is not written if the key is not changed
+   */
+  static handle_result_t apply_name_map_key(HrLoRa::name_map_key_t key) {
+    if (Callbacks::get_name_map_key() == key) {
+      ESP_LOGI(TAG, "name map key is already %d", key);
+      return handle_result_t::ok;
+    }
+    Callbacks::set_name_map_key(key);
+    auto err = app_nvs::set_name_map_key(key);
+    ESP_LOGI(TAG, "set name map key to %d", key);
+    return err == ESP_OK ? handle_result_t::ok : handle_result_t::failed;
+  }
+
+  /**
+   * @brief a frame from other repeater. Relay it if the relay mode is enabled.
+   */
+  static handle_result_t overheard(std::span<const uint8_t> frame) {
+    Callbacks::on_overheard(frame.data(), frame.size());
+    return handle_result_t::ignored;
+  }
+
+public:
+  /**
+   * @param response where the response is held back, nullptr to send it right away
+   */
+  explicit MessageHandler(command_response_t *response = nullptr, uint8_t depth = 0)
+      : my_addr_native(my_addr.getNative()), response(response), depth(depth) {}
+
+  handle_result_t on_message(const HrLoRa::query_device_by_mac::t &req, std::span<const uint8_t>) {
+    bool is_broadcast = std::equal(req.addr.begin(), req.addr.end(), HrLoRa::broadcast_addr.data());
+    bool eq           = is_broadcast || std::equal(req.addr.begin(), req.addr.end(), my_addr_native);
+    if (!eq) {
+      ESP_LOGI(TAG, "%s is not for me", utils::toHex(req.addr.data(), req.addr.size()).c_str());
+      return handle_result_t::ignored;
+    }
+    auto resp = HrLoRa::query_device_by_mac_response::t{
+        .repeater_addr = HrLoRa::addr_t{},
+        .key           = Callbacks::get_name_map_key(),
+    };
+    std::copy(my_addr_native, my_addr_native + HrLoRa::BLE_ADDR_SIZE, resp.repeater_addr.data());
+    resp.device = Callbacks::get_device();
+    uint8_t buf[64];
+    auto sz = HrLoRa::query_device_by_mac_response::marshal(resp, buf, sizeof(buf));
+    if (sz == 0) {
+      ESP_LOGE(TAG, "failed to marshal query_device_by_mac_response");
+      return handle_result_t::ignored;
+    }
+    reply(buf, sz);
+    return handle_result_t::ok;
+  }
+
+  handle_result_t on_message(const HrLoRa::set_name_map_key::t &req, std::span<const uint8_t>) {
+    bool eq = std::equal(req.addr.begin(), req.addr.end(), my_addr_native);
+    if (!eq) {
+      ESP_LOGI(TAG, "%s is not for me", utils::toHex(req.addr.data(), req.addr.size()).c_str());
+      return handle_result_t::ignored;
+    }
+    return apply_name_map_key(req.key);
+  }
+
+  handle_result_t on_message(const HrLoRa::roster::t &roster, std::span<const uint8_t>) {
+    etl::optional<size_t> index;
+    if (roster.addr_size == HrLoRa::BLE_ADDR_SIZE) {
+      index = roster.index_of(std::span<const uint8_t>{my_addr_native, HrLoRa::BLE_ADDR_SIZE});
+    } else if (roster.addr_size == HrLoRa::SHORT_ADDR_SIZE) {
+      auto short_addr = Callbacks::get_short_addr();
+      if (short_addr == HrLoRa::unassigned_short_addr) {
+        return handle_result_t::ignored;
       }
+      uint8_t short_addr_be[HrLoRa::SHORT_ADDR_SIZE];
+      HrLoRa::write_short_addr(short_addr, short_addr_be);
+      index = roster.index_of(short_addr_be);
+    } else {
+      ESP_LOGW(TAG, "unsupported roster address size %d", roster.addr_size);
+      return handle_result_t::ignored;
+    }
+    if (!index) {
+      ESP_LOGD(TAG, "not in roster fragment %d/%d", roster.frag_index + 1, roster.frag_count);
+      return handle_result_t::ignored;
+    }
+    if (response != nullptr) {
+      // every repeater in the fragment acknowledges it
+      response->rank = static_cast<uint8_t>(*index);
+    }
+    return apply_name_map_key(roster.at(*index).key);
+  }
+
+  handle_result_t on_message(const HrLoRa::lease_short_addr::t &req, std::span<const uint8_t>) {
+    bool eq = std::equal(req.addr.begin(), req.addr.end(), my_addr_native);
+    if (!eq) {
+      return handle_result_t::ignored;
+    }
+    if (req.short_addr == HrLoRa::broadcast_short_addr) {
+      ESP_LOGW(TAG, "broadcast short address could not be leased");
+      return handle_result_t::ignored;
+    }
+    if (Callbacks::get_short_addr() == req.short_addr) {
+      return handle_result_t::ok;
+    }
+    Callbacks::set_short_addr(req.short_addr);
+    auto err = app_nvs::set_short_addr(req.short_addr);
+    ESP_LOGI(TAG, "set short address to %04x", req.short_addr);
+    return err == ESP_OK ? handle_result_t::ok : handle_result_t::failed;
+  }
+
+  handle_result_t on_message(const HrLoRa::query_device_by_short::t &req, std::span<const uint8_t>) {
+    auto short_addr   = Callbacks::get_short_addr();
+    bool is_broadcast = req.short_addr == HrLoRa::broadcast_short_addr;
+    if (!is_broadcast && (short_addr == HrLoRa::unassigned_short_addr || req.short_addr != short_addr)) {
+      return handle_result_t::ignored;
+    }
+    uint8_t buf[64];
+    size_t sz = 0;
+    if (short_addr == HrLoRa::unassigned_short_addr) {
+      // not leased yet. answer with the MAC so that the hub could lease one.
       auto resp = HrLoRa::query_device_by_mac_response::t{
           .repeater_addr = HrLoRa::addr_t{},
-          .key           = callbacks.get_name_map_key(),
+          .key           = Callbacks::get_name_map_key(),
+          .device        = Callbacks::get_device(),
       };
       std::copy(my_addr_native, my_addr_native + HrLoRa::BLE_ADDR_SIZE, resp.repeater_addr.data());
-      auto device = callbacks.get_device();
-      if (device) {
-        auto dev = HrLoRa::hr_device::t{};
-        std::copy(device->addr.begin(), device->addr.end(), dev.addr.data());
-        dev.name = device->name;
-      } else {
-        resp.device = etl::nullopt;
-      }
-      uint8_t buf[64];
-      auto sz = HrLoRa::query_device_by_mac_response::marshal(resp, buf, sizeof(buf));
-      if (sz == 0) {
-        ESP_LOGE(TAG, "failed to marshal query_device_by_mac_response");
-        break;
+      sz = HrLoRa::query_device_by_mac_response::marshal(resp, buf, sizeof(buf));
+    } else {
+      auto resp = HrLoRa::query_device_by_short_response::t{
+          .short_addr = short_addr,
+          .key        = Callbacks::get_name_map_key(),
+          .device     = Callbacks::get_device(),
+      };
+      sz = HrLoRa::query_device_by_short_response::marshal(resp, buf, sizeof(buf));
+    }
+    if (sz == 0) {
+      ESP_LOGE(TAG, "failed to marshal query_device_by_short_response");
+      return handle_result_t::ignored;
+    }
+    reply(buf, sz);
+    return handle_result_t::ok;
+  }
+
+  handle_result_t on_message(const HrLoRa::set_name_map_key_short::t &req, std::span<const uint8_t>) {
+    auto short_addr = Callbacks::get_short_addr();
+    if (short_addr == HrLoRa::unassigned_short_addr || req.short_addr != short_addr) {
+      return handle_result_t::ignored;
+    }
+    return apply_name_map_key(req.key);
+  }
+
+  handle_result_t on_message(const HrLoRa::command::t &cmd, std::span<const uint8_t>) {
+    if (cmd.payload[0] == HrLoRa::command::magic) {
+      ESP_LOGW(TAG, "nested command is not allowed");
+      return handle_result_t::ignored;
+    }
+    if (depth > max_depth) {
+      ESP_LOGW(TAG, "command nested too deep (%d)", depth);
+      return handle_result_t::ignored;
+    }
+    const uint32_t now_ms = esp_timer_get_time() / 1000;
+    auto status           = HrLoRa::ack::status_t::ok;
+    auto resp             = command_response_t{};
+    auto resp_frame       = std::span<const uint8_t>{};
+    auto cached           = handled_commands.find(cmd.cmd_id, now_ms, common::COMMAND_CACHE_TTL.count());
+    if (cached) {
+      // a retransmission, since our ack (or the response) is lost. don't apply it again.
+      ESP_LOGI(TAG, "duplicated command %d", cmd.cmd_id);
+      status     = cached->status;
+      resp_frame = cached->response;
+      resp.rank  = cached->rank;
+    } else {
+      auto res = handle_message<Callbacks>(cmd.payload.data(), cmd.payload.size(), &resp, depth + 1);
+      if (res == handle_result_t::ignored) {
+        return handle_result_t::ignored;
       }
-      callbacks.send(buf, sz);
-      break;
+      status     = res == handle_result_t::ok ? HrLoRa::ack::status_t::ok : HrLoRa::ack::status_t::failed;
+      resp_frame = std::span<const uint8_t>{resp.buf, resp.size};
+      handled_commands.insert(cmd.cmd_id, status, resp_frame, resp.rank, now_ms);
+    }
+    auto ack = HrLoRa::ack::t{
+        .cmd_id        = cmd.cmd_id,
+        .repeater_addr = HrLoRa::addr_t{},
+        .status        = status,
+    };
+    std::copy(my_addr_native, my_addr_native + HrLoRa::BLE_ADDR_SIZE, ack.repeater_addr.data());
+    uint8_t ack_buf[HrLoRa::ack::size_needed()];
+    auto ack_sz = HrLoRa::ack::marshal(ack, ack_buf, sizeof(ack_buf));
+    if (resp_frame.empty()) {
+      Callbacks::send(ack_buf, ack_sz, resp.rank);
+    } else {
+      // the response and its ack in one frame
+      static_assert(common::SLOT_FRAME_MAX_SIZE >= 1 + (1 + HrLoRa::command::max_response_size) + (1 + HrLoRa::ack::size_needed()));
+      uint8_t buf[common::SLOT_FRAME_MAX_SIZE];
+      auto bundle = HrLoRa::bundle::builder(buf, sizeof(buf));
+      bundle.append(resp_frame);
+      bundle.append(std::span<const uint8_t>{ack_buf, ack_sz});
+      Callbacks::send(buf, bundle.size(), resp.rank);
     }
-    case HrLoRa::set_name_map_key::magic: {
-      auto r = HrLoRa::set_name_map_key::unmarshal(data, size);
-      if (!r) {
-        ESP_LOGE(TAG, "failed to unmarshal set_name_map_key");
-        break;
+    return status == HrLoRa::ack::status_t::ok ? handle_result_t::ok : handle_result_t::failed;
+  }
+
+  handle_result_t on_message(const HrLoRa::bundle::t &bundle, std::span<const uint8_t>) {
+    // any failure fails the bundle; otherwise ok if any sub-message is for us
+    auto result = handle_result_t::ignored;
+    if (depth > max_depth) {
+      ESP_LOGW(TAG, "bundle nested too deep (%d)", depth);
+      return result;
+    }
+    for (auto sub : bundle) {
+      if (sub[0] == HrLoRa::bundle::magic) {
+        ESP_LOGW(TAG, "nested bundle is not allowed");
+        continue;
+      }
+      auto res = handle_message<Callbacks>(sub.data(), sub.size(), response, depth + 1);
+      if (res == handle_result_t::failed) {
+        result = handle_result_t::failed;
+      } else if (res == handle_result_t::ok && result == handle_result_t::ignored) {
+        result = handle_result_t::ok;
       }
-      auto &req = r.value();
-      callbacks.set_name_map_key(req.key);
-      app_nvs::set_name_map_key(req.key);
-      ESP_LOGI(TAG, "set name map key to %d", req.key);
-      break;
     }
-    case HrLoRa::hr_data::magic:
-    case HrLoRa::query_device_by_mac_response::magic: {
-      // from other repeater. do nothing.
-      return;
+    return result;
+  }
+
+  handle_result_t on_message(const HrLoRa::load_control::t &req, std::span<const uint8_t>) {
+    auto short_addr   = Callbacks::get_short_addr();
+    bool is_broadcast = req.short_addr == HrLoRa::broadcast_short_addr;
+    if (!is_broadcast && (short_addr == HrLoRa::unassigned_short_addr || req.short_addr != short_addr)) {
+      return handle_result_t::ignored;
     }
-    default: {
-      ESP_LOGW("recv", "unknown magic: %d", magic);
+    Callbacks::on_load_control(req);
+    return handle_result_t::ok;
+  }
+
+  handle_result_t on_message(const HrLoRa::set_report_mode::t &req, std::span<const uint8_t>) {
+    auto short_addr   = Callbacks::get_short_addr();
+    bool is_broadcast = req.short_addr == HrLoRa::broadcast_short_addr;
+    if (!is_broadcast && (short_addr == HrLoRa::unassigned_short_addr || req.short_addr != short_addr)) {
+      return handle_result_t::ignored;
+    }
+    if (req.mode != HrLoRa::set_report_mode::mode_t::raw && req.mode != HrLoRa::set_report_mode::mode_t::aggregate) {
+      ESP_LOGW(TAG, "unknown report mode %d", static_cast<int>(req.mode));
+      return handle_result_t::failed;
     }
+    Callbacks::on_report_mode(req);
+    return handle_result_t::ok;
+  }
+
+  handle_result_t on_message(const HrLoRa::beacon::t &beacon, std::span<const uint8_t>) {
+    Callbacks::on_beacon(beacon);
+    return handle_result_t::ignored;
+  }
+
+  handle_result_t on_message(const HrLoRa::hr_data::t &, std::span<const uint8_t> frame) {
+    return overheard(frame);
+  }
+
+  handle_result_t on_message(const HrLoRa::hr_data_v2::t &, std::span<const uint8_t> frame) {
+    return overheard(frame);
+  }
+
+  handle_result_t on_message(const HrLoRa::hr_data_redundant::t &, std::span<const uint8_t> frame) {
+    return overheard(frame);
+  }
+
+  handle_result_t on_message(const HrLoRa::hr_alarm::t &, std::span<const uint8_t> frame) {
+    return overheard(frame);
+  }
+
+  handle_result_t on_message(const HrLoRa::hrv_summary::t &, std::span<const uint8_t> frame) {
+    return overheard(frame);
+  }
+
+  handle_result_t on_message(const HrLoRa::hr_aggregate::t &, std::span<const uint8_t> frame) {
+    return overheard(frame);
+  }
+
+  handle_result_t on_message(const HrLoRa::query_device_by_mac_response::t &, std::span<const uint8_t> frame) {
+    return overheard(frame);
   }
+
+  handle_result_t on_message(const HrLoRa::query_device_by_short_response::t &, std::span<const uint8_t> frame) {
+    return overheard(frame);
+  }
+
+  handle_result_t on_message(const HrLoRa::query_diagnostics::t &req, std::span<const uint8_t>) {
+    auto short_addr   = Callbacks::get_short_addr();
+    bool is_broadcast = req.short_addr == HrLoRa::broadcast_short_addr;
+    if (!is_broadcast && (short_addr == HrLoRa::unassigned_short_addr || req.short_addr != short_addr)) {
+      return handle_result_t::ignored;
+    }
+    auto resp       = static_cast<HrLoRa::diagnostics_response::t>(Callbacks::get_diagnostics());
+    resp.short_addr = short_addr;
+    resp.key        = Callbacks::get_name_map_key();
+    uint8_t buf[HrLoRa::diagnostics_response::size_needed()];
+    auto sz = HrLoRa::diagnostics_response::marshal(resp, buf, sizeof(buf));
+    if (sz == 0) {
+      ESP_LOGE(TAG, "failed to marshal diagnostics_response");
+      return handle_result_t::ignored;
+    }
+    reply(buf, sz);
+    return handle_result_t::ok;
+  }
+
+  handle_result_t on_message(const HrLoRa::diagnostics_response::t &, std::span<const uint8_t> frame) {
+    return overheard(frame);
+  }
+
+  handle_result_t on_message(const HrLoRa::relay::t &, std::span<const uint8_t> frame) {
+    return overheard(frame);
+  }
+
+  handle_result_t on_message(const HrLoRa::ack::t &, std::span<const uint8_t> frame) {
+    return overheard(frame);
+  }
+
+  handle_result_t on_error(HrLoRa::hr_lora_msg::unknown_t e, std::span<const uint8_t>) {
+    ESP_LOGW(TAG, "unknown magic: %d", e.magic);
+    return handle_result_t::ignored;
+  }
+
+  handle_result_t on_error(HrLoRa::hr_lora_msg::malformed_t e, std::span<const uint8_t>) {
+    ESP_LOGE(TAG, "failed to unmarshal message with magic %02x", e.magic);
+    return handle_result_t::ignored;
+  }
+};
+
+/**
+ * @brief handle the message received from LoRa
+ * @param data the data received
+ * @param size the size of the data
+ * @param response where the response is held back (see `command_response_t`), nullptr to send it right away
+ * @param depth the envelopes around the message, see `MessageHandler::max_depth`
+ * @tparam Callbacks the actions of the repeater. See `handle_message_callbacks`.
+ * @return whether the message is a control message for this repeater and if it's applied successfully
+ */
+template <handle_message_callbacks Callbacks>
+handle_result_t handle_message(const uint8_t *data, size_t size, command_response_t *response, uint8_t depth) {
+  auto handler = MessageHandler<Callbacks>{response, depth};
+  return HrLoRa::hr_lora_msg::dispatch(handler, data, size);
 }
 
 void app_main() {
@@ -127,6 +575,8 @@ void app_main() {
 
   auto err = app_nvs::nvs_init();
   ESP_ERROR_CHECK(err);
+  err = power::init();
+  ESP_ERROR_CHECK(err);
   app_nvs::addr_t addr{0};
   bool has_addr = false;
   err           = app_nvs::get_addr(&addr);
@@ -149,14 +599,28 @@ void app_main() {
     ESP_LOGI(TAG, "name map key=%d", *name_map_key_ptr);
   }
 
-  static auto hal = ESPHal(pin::SCK, pin::MISO, pin::MOSI);
+  /**
+   * @brief the short address leased by the hub. Unassigned until the first lease.
+   */
+  static auto short_addr = HrLoRa::unassigned_short_addr;
+  err                    = app_nvs::get_short_addr(&short_addr);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "no short address; reason %s (%d);", esp_err_to_name(err), err);
+  } else {
+    ESP_LOGI(TAG, "short address=%04x", short_addr);
+  }
+
+  static auto hal = ESPHal(pin::SCK, pin::MISO, pin::MOSI, pin::CS);
   hal.init();
+  err = hal.enableBusyInterrupt(pin::BUSY);
+  if (err != ESP_OK) {
+    // RadioLib polls BUSY as before
+    ESP_LOGW(TAG, "no busy interrupt; reason %s (%d);", esp_err_to_name(err), err);
+  }
   ESP_LOGI(TAG, "hal init success!");
   static auto module = Module(&hal, pin::CS, pin::DIO1, pin::RST, pin::BUSY);
   static auto rf     = LLCC68(&module);
-  auto st            = rf.begin(434, 500.0, 7, 7,
-                                RADIOLIB_SX126X_SYNC_WORD_PRIVATE,
-                                22, 8, 1.6);
+  auto st            = radio::begin(rf, radio::active_profile);
   if (st != RADIOLIB_ERR_NONE) {
     ESP_LOGE(TAG, "failed, code %d", st);
     vTaskDelay(1000 / portTICK_PERIOD_MS);
@@ -164,30 +628,199 @@ void app_main() {
   }
   ESP_LOGI(TAG, "RF began!");
 
-  /** Radio receive interruption */
-  struct rf_recv_interrupt_data_t {
-    EventGroupHandle_t evt_grp;
-  };
-  auto evt_grp = xEventGroupCreate();
+  static auto evt_grp = xEventGroupCreate();
 
+  err = hal.attachInterrupt<dio1_ctx_t, on_dio1>(pin::DIO1, &dio1_ctx, RISING);
+  ESP_ERROR_CHECK(err);
   /**
-   * used in `rf.setPacketReceivedAction`
-   * a workaround to pass an argument to ISR.
-   * Actually ESP IDF has a API to pass an argument to ISR (`gpio_isr_handler_add`),
-   * but RadioLib doesn't use it and I don't want to break the API (though I can).
+   * @brief wake the radio task with the `*Evt` bits
+   * @note dropped before the task runs, which checks the queues at start
    */
-  static auto rf_recv_interrupt_data = rf_recv_interrupt_data_t{evt_grp};
-  rf.setPacketReceivedAction([]() {
-    // https://www.freertos.org/xEventGroupSetBitsFromISR.html
-    BaseType_t task_woken = pdFALSE;
-    auto xResult          = xEventGroupSetBitsFromISR(rf_recv_interrupt_data.evt_grp, RecvEvt, &task_woken);
-    if (xResult != pdFAIL) {
-      portYIELD_FROM_ISR(task_woken);
+  static auto notify_radio = [](uint32_t bits) {
+    if (auto task = dio1_ctx.task; task != nullptr) {
+      xTaskNotify(task, bits, eSetBits);
     }
-  });
+  };
+  err = power::enable_wakeup(pin::DIO1);
+  ESP_ERROR_CHECK(err);
 
+  if constexpr (radio::active_profile.rx_mode == radio::rx_mode_t::duty_cycle) {
+    constexpr auto sniff = radio::sniff_estimate(radio::active_profile);
+    ESP_LOGI(TAG, "rx duty cycle: listen=%" PRIu32 "us sleep=%" PRIu32 "us; +%" PRIu32 "ms per downlink; ~%" PRIu32 "uA (continuous %" PRIu32 "uA)",
+             sniff.listen_us, sniff.sleep_us, sniff.extra_latency_us / 1000, sniff.avg_current_ua, radio::sniff_estimate_t::rx_current_ua);
+  }
   rf.standby();
-  rf.startReceive();
+  radio::start_receive(rf, radio::active_profile);
+
+  /**
+   * @brief the latest `hr_data` waiting for the TDMA slot.
+   * Only the latest sample is kept since a slot carries one frame.
+   */
+  static auto pending_hr_data = xQueueCreate(1, sizeof(HrLoRa::hr_data::t));
+  static auto scheduler       = tdma::Scheduler();
+  err                         = scheduler.init();
+  ESP_ERROR_CHECK(err);
+  scheduler.on_slot = []() {
+    notify_radio(SlotEvt);
+  };
+  constexpr bool windowed_rx = radio::active_profile.rx_mode == radio::rx_mode_t::windowed;
+  static auto rx_windows     = tdma::RxWindows(std::chrono::milliseconds(radio::active_profile.rx_window_ms),
+                                               std::chrono::milliseconds(radio::active_profile.rx_guard_ms));
+  if constexpr (windowed_rx) {
+    err = rx_windows.init();
+    ESP_ERROR_CHECK(err);
+    rx_windows.on_change = []() {
+      notify_radio(RxWinEvt);
+    };
+  }
+
+  static auto encoder = telemetry::Encoder(radio::active_profile);
+  static auto policy  = telemetry::ReportPolicy();
+  static auto alarms  = telemetry::AlarmDetector();
+  struct alarm_job_t {
+    HrLoRa::hr_alarm::t alarm;
+    /// when the crossing is seen (`esp_timer_get_time`)
+    int64_t detected_us;
+  };
+  /**
+   * @brief the alarms waiting for the radio task, which bypass the reporting policy and the TDMA slot
+   */
+  static auto pending_alarms = xQueueCreate(ALARM_QUEUE_SIZE, sizeof(alarm_job_t));
+
+  static auto hrv_analyzer = hrv::Analyzer();
+  static auto hrv_reporter = hrv::Reporter();
+  static auto aggregator   = telemetry::Aggregator();
+  static auto report_mode  = std::atomic<HrLoRa::set_report_mode::mode_t>{HrLoRa::set_report_mode::mode_t::raw};
+  /**
+   * @brief a marshalled frame other than `hr_data` (e.g. `hrv_summary`, `hr_aggregate`, or a relay)
+   *        for the TDMA slot
+   */
+  struct slot_frame_t {
+    uint8_t buf[SLOT_FRAME_MAX_SIZE];
+    size_t size;
+  };
+  static_assert(HrLoRa::hrv_summary::size_needed() <= sizeof(slot_frame_t::buf));
+  static_assert(HrLoRa::hr_aggregate::size_needed() <= sizeof(slot_frame_t::buf));
+  static_assert(HrLoRa::relay::max_payload_size + 2 <= sizeof(slot_frame_t::buf));
+  /**
+   * @brief the frames waiting for the TDMA slot, which go before `hr_data`
+   */
+  static auto pending_frames = xQueueCreate(SLOT_FRAME_QUEUE_SIZE, sizeof(slot_frame_t));
+
+  /**
+   * @brief the received packets, filled by the radio task and handled by the parser task
+   */
+  static auto rx_pool = rx::Pool<RX_POOL_SIZE>();
+  /**
+   * @brief the `rx_time_us` of the packet being handled by the parser task
+   */
+  static int64_t parsing_rx_time_us = 0;
+  struct tx_frame_t {
+    uint8_t buf[255];
+    size_t size;
+    /// see `tryTransmit`
+    bool is_telemetry;
+    /// when it's due (`esp_timer_get_time`), i.e. when it's queued unless delayed
+    int64_t due_us;
+  };
+  /**
+   * @brief the frames to transmit as soon as possible, so that only the radio task touches the radio
+   */
+  static auto pending_tx = xQueueCreate(TX_QUEUE_SIZE, sizeof(tx_frame_t));
+  /**
+   * @brief the delayed frames (see `REPLY_MAX_JITTER`), which don't hold `pending_tx` back
+   */
+  static auto pending_delayed_tx = xQueueCreate(REPLY_QUEUE_SIZE, sizeof(tx_frame_t));
+  /**
+   * @brief wakes the radio task for the head of `pending_delayed_tx`
+   */
+  static esp_timer_handle_t delayed_tx_timer = nullptr;
+  esp_timer_create_args_t delayed_tx_timer_args = {
+      .callback              = [](void *) { notify_radio(TxEvt); },
+      .arg                   = nullptr,
+      .dispatch_method       = ESP_TIMER_TASK,
+      .name                  = "delayed_tx",
+      .skip_unhandled_events = true,
+  };
+  err = esp_timer_create(&delayed_tx_timer_args, &delayed_tx_timer);
+  ESP_ERROR_CHECK(err);
+  // the debug path of the histograms, which the hot paths only record into
+  if constexpr (DEBUG_DUMP_INTERVAL.count() != 0) {
+    static esp_timer_handle_t debug_dump_timer = nullptr;
+    esp_timer_create_args_t debug_dump_timer_args = {
+        .callback              = [](void *) {
+          radio::metrics.dump();
+          trace::alarm_latency.dump();
+          trace::dump_wake_latency();
+          hal.busyWaitHistogram().dump();
+        },
+        .arg                   = nullptr,
+        .dispatch_method       = ESP_TIMER_TASK,
+        .name                  = "debug_dump",
+        .skip_unhandled_events = true,
+    };
+    err = esp_timer_create(&debug_dump_timer_args, &debug_dump_timer);
+    ESP_ERROR_CHECK(err);
+    const auto interval_us = std::chrono::duration_cast<std::chrono::microseconds>(DEBUG_DUMP_INTERVAL);
+    err                    = esp_timer_start_periodic(debug_dump_timer, interval_us.count());
+    ESP_ERROR_CHECK(err);
+  }
+  static auto queue_tx = [](const uint8_t *data, size_t size, bool is_telemetry, int64_t delay_us = 0) {
+    const auto TAG = "queue_tx";
+    if (size > sizeof(tx_frame_t::buf)) {
+      ESP_LOGE(TAG, "frame too large (%zu)", size);
+      return;
+    }
+    auto frame = tx_frame_t{.size = size, .is_telemetry = is_telemetry, .due_us = esp_timer_get_time() + delay_us};
+    std::copy(data, data + size, frame.buf);
+    auto queue = delay_us == 0 ? pending_tx : pending_delayed_tx;
+    if (xQueueSendToBack(queue, &frame, 0) != pdTRUE) {
+      ESP_LOGW(TAG, "tx queue full; drop 0x%02x", data[0]);
+      return;
+    }
+    notify_radio(TxEvt);
+  };
+  /**
+   * @brief send a marshalled frame in the slot of this repeater, or right away if not synced
+   * @note called from the BLE callback and the parser task
+   */
+  static auto send_in_slot = [](const uint8_t *data, size_t size) {
+    const auto TAG = "send_in_slot";
+    if (size > sizeof(slot_frame_t::buf)) {
+      ESP_LOGE(TAG, "frame too large (%zu)", size);
+      return;
+    }
+    if (!scheduler.is_synced()) {
+      queue_tx(data, size, false);
+      return;
+    }
+    auto frame = slot_frame_t{.size = size};
+    std::copy(data, data + size, frame.buf);
+    if (xQueueSendToBack(pending_frames, &frame, 0) != pdTRUE) {
+      ESP_LOGW(TAG, "slot queue full; drop 0x%02x", data[0]);
+    }
+  };
+  /**
+   * @brief loss and reorder counters of the `hr_data_v2` (or `hr_data_redundant`)
+   *        overheard from other repeaters
+   */
+  static auto overheard_seq = HrLoRa::seq_tracker<OVERHEARD_SEQ_KEYS>();
+
+  static auto relay = mesh::Relay();
+  static_assert(!(RELAY_ENABLED && radio::active_profile.rx_mode != radio::rx_mode_t::continuous),
+                "a relay has to overhear the other repeaters (with the short preamble) all the time");
+  static_assert(!(RELAY_ENABLED && radio::active_profile.implicit_hr_data),
+                "a relay has to overhear the telemetry frames, which are sent in implicit header otherwise");
+  if constexpr (RELAY_ENABLED) {
+    err = relay.init();
+    ESP_ERROR_CHECK(err);
+    relay.on_due = []() {
+      xEventGroupSetBits(evt_grp, RelayEvt);
+    };
+    relay.time_on_air = [](size_t len) {
+      return rf.getTimeOnAir(len);
+    };
+  }
 
   NimBLEDevice::init(BLE_NAME);
   auto &server          = *NimBLEDevice::createServer();
@@ -203,6 +836,8 @@ void app_main() {
                                                           NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::WRITE | NIMBLE_PROPERTY::NOTIFY);
   auto &device_char    = *hr_service.createCharacteristic(BLE_CHAR_DEVICE_UUID,
                                                           NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY);
+  auto &diag_char      = *hr_service.createCharacteristic(BLE_CHAR_DIAGNOSTICS_UUID,
+                                                          NIMBLE_PROPERTY::READ);
   static auto white_cb = WhiteListCallback();
   white_char.setCallbacks(&white_cb);
   white_cb.on_request_address = []() {
@@ -229,24 +864,298 @@ void app_main() {
     EventGroupHandle_t evt_grp;
   };
 
-  static auto handle_message_callbacks = handle_message_callbacks_t{
-      .send             = [](uint8_t *data, size_t size) { tryTransmit(data, size, rf); },
-      .get_device       = []() { return scan_manager.get_device(); },
-      .set_name_map_key = [name_map_key_ptr](HrLoRa::name_map_key_t key) { *name_map_key_ptr = key; },
-      .get_name_map_key = [name_map_key_ptr]() { return *name_map_key_ptr; },
+  /**
+   * @brief see `handle_message_callbacks`
+   */
+  struct callbacks {
+    /**
+     * @brief answer the hub in the slot of this repeater, or after a delay if not synced,
+     *        as a broadcast (or a roster) is answered by many repeaters
+     * @param rank the position among the repeaters answering the same frame, which are
+     *        staggered by `REPLY_RANK_SPACING`; a random jitter if unknown
+     */
+    static void send(uint8_t *data, size_t size, etl::optional<uint8_t> rank = etl::nullopt) {
+      if (scheduler.is_synced()) {
+        send_in_slot(data, size);
+        return;
+      }
+      const int64_t delay_us = rank ? *rank * REPLY_RANK_SPACING.count() * 1000LL
+                                    : esp_random() % (REPLY_MAX_JITTER.count() * 1000 + 1);
+      // 0 would skip the delayed queue, which keeps the order of the answers
+      queue_tx(data, size, false, std::max<int64_t>(delay_us, 1));
+    }
+
+    static etl::optional<HrLoRa::hr_device::t> get_device() {
+      auto device = scan_manager.peek_device();
+      if (device == nullptr) {
+        return etl::nullopt;
+      }
+      auto dev = HrLoRa::hr_device::t{};
+      std::copy(device->addr.begin(), device->addr.end(), dev.addr.data());
+      dev.name.assign(device->name.data(), std::min(device->name.size(), HrLoRa::hr_device::max_name_size));
+      return dev;
+    }
+
+    static void set_name_map_key(HrLoRa::name_map_key_t key) {
+      name_map_key = key;
+    }
+
+    static HrLoRa::name_map_key_t get_name_map_key() {
+      return name_map_key;
+    }
+
+    static void set_short_addr(HrLoRa::short_addr_t addr) {
+      short_addr = addr;
+    }
+
+    static HrLoRa::short_addr_t get_short_addr() {
+      return short_addr;
+    }
+
+    static HrLoRa::diagnostics_response::t get_diagnostics() {
+      auto diag       = radio::metrics.snapshot();
+      diag.rx_dropped = static_cast<uint16_t>(rx_pool.dropped_count());
+      return diag;
+    }
+
+    static void on_beacon(const HrLoRa::beacon::t &beacon) {
+      scheduler.on_beacon(beacon, parsing_rx_time_us, name_map_key);
+      if constexpr (windowed_rx) {
+        rx_windows.on_beacon(beacon, parsing_rx_time_us);
+      }
+    }
+
+    static void on_report_mode(const HrLoRa::set_report_mode::t &req) {
+      const auto TAG = "report_mode";
+      if (req.window_s != 0) {
+        aggregator.set_window(std::chrono::seconds(req.window_s));
+      }
+      report_mode = req.mode;
+      ESP_LOGI(TAG, "mode=%d window=%llds", static_cast<int>(req.mode), aggregator.window().count());
+    }
+
+    static void on_load_control(const HrLoRa::load_control::t &load) {
+      const auto TAG = "load_control";
+      const auto now = esp_timer_get_time();
+      int64_t until  = load.hold_s == 0 ? 0 : now + load.hold_s * 1'000'000LL;
+      policy.set_min_interval(std::chrono::milliseconds(load.interval_ms), until);
+      ESP_LOGI(TAG, "min interval=%dms hold=%ds; throttled=%zu", load.interval_ms, load.hold_s, policy.throttled_count());
+    }
+
+    static void on_overheard(const uint8_t *data, size_t size) {
+      const auto TAG = "overheard";
+      auto frame     = std::span<const uint8_t>{data, size};
+      if (data[0] == HrLoRa::relay::magic) {
+        auto r = HrLoRa::relay::unmarshal(data, size);
+        if (r) {
+          frame = r->payload;
+        }
+      }
+      const auto origin = HrLoRa::relay::origin_key(frame);
+      // our own frame relayed by another repeater, which is neither tracked nor relayed again
+      if (origin && *origin == name_map_key) {
+        return;
+      }
+      if (origin && (data[0] == HrLoRa::hr_data::magic || data[0] == HrLoRa::hr_data_v2::magic ||
+                     data[0] == HrLoRa::hr_data_redundant::magic || data[0] == HrLoRa::hrv_summary::magic ||
+                     data[0] == HrLoRa::hr_aggregate::magic)) {
+        // sent in the slot of its origin, unlike a relayed one. Only the explicit header frames
+        // are heard with `implicit_hr_data` (see `radio::profile_t`)
+        scheduler.check_conflict(*origin, name_map_key);
+      }
+      auto track = [TAG](HrLoRa::name_map_key_t key, uint8_t seq) {
+        auto res    = overheard_seq.update(key, seq);
+        auto &stats = overheard_seq.stats(key);
+        ESP_LOGD(TAG, "key=%d seq=%d (%s); recv=%" PRIu32 " lost=%" PRIu32 " reordered=%" PRIu32,
+                 key, seq,
+                 res == HrLoRa::seq_result_t::duplicated ? "dup" : (res == HrLoRa::seq_result_t::reordered ? "late" : "ok"),
+                 stats.received, stats.lost, stats.reordered);
+      };
+      if (auto v2 = HrLoRa::hr_data_v2::unmarshal(frame.data(), frame.size())) {
+        track(v2->key, v2->seq);
+      } else if (auto r = HrLoRa::hr_data_redundant::unmarshal(frame.data(), frame.size())) {
+        track(r->key, r->seq);
+      }
+      if constexpr (RELAY_ENABLED) {
+        relay.on_overheard(data, size, name_map_key);
+      }
+    }
   };
 
-  auto recv_task = [evt_grp](LLCC68 &rf) {
+  static auto diag_cb = DiagnosticsCallback();
+  diag_char.setCallbacks(&diag_cb);
+  diag_cb.on_request = callbacks::get_diagnostics;
+
+  /**
+   * @brief the only task touching the radio. The received packets are handed to `parse_task`.
+   */
+  auto recv_task = [](LLCC68 &rf) {
     const auto TAG = "recv";
+    // whether the radio is receiving, or sleeping between the receive windows
+    bool listening = true;
+    dio1_ctx.task  = xTaskGetCurrentTaskHandle();
+    // anything before the task runs, e.g. a packet (DIO1 stays high until it's read)
+    xTaskNotify(dio1_ctx.task, AlarmEvt | TxEvt | (gpio_get_level(dio1_ctx.pin) ? RecvEvt : 0), eSetBits);
     for (;;) {
-      xEventGroupWaitBits(evt_grp, RecvEvt, pdTRUE, pdFALSE, portMAX_DELAY);
-      uint8_t data[255];
-      size_t size = rf.receive(data, sizeof(data));
-      if (size == 0) {
-        ESP_LOGW(TAG, "empty data");
+      uint32_t bits = 0;
+      xTaskNotifyWait(0, UINT32_MAX, &bits, portMAX_DELAY);
+      etl::optional<uint16_t> irq = etl::nullopt;
+      if (bits & RecvEvt) {
+        irq = radio::irq_status(rf);
+        // DIO1 also fires on TX done and CAD done, which leave no packet. Only those flags are
+        // cleared, so a packet received after `tryTransmit` restarts receiving is still read.
+        const bool received = irq ? (*irq & radio::rx_irq_flags) != 0 : gpio_get_level(dio1_ctx.pin) != 0;
+        if (!received) {
+          radio::clear_irq(rf, RADIOLIB_SX126X_IRQ_TX_DONE | RADIOLIB_SX126X_IRQ_CAD_DONE |
+                                   RADIOLIB_SX126X_IRQ_CAD_DETECTED);
+          bits &= ~RecvEvt;
+        }
+      }
+      // read the packet first, since a transmission overwrites the radio buffer
+      if (bits & RecvEvt) {
+        trace::wake_dio1.record(esp_timer_get_time() - dio1_ctx.rx_time_us);
+        auto rx = rx_pool.acquire();
+        if (rx == nullptr) {
+          ESP_LOGW(TAG, "rx pool exhausted; dropped=%zu", rx_pool.dropped_count());
+          // clear the IRQ and keep receiving
+          radio::start_receive(rf, radio::active_profile);
+        } else {
+          const size_t len = rf.getPacketLength();
+          auto st          = rf.readData(rx->data, std::min(len, sizeof(rx->data)));
+          if (st == RADIOLIB_ERR_CRC_MISMATCH) {
+            radio::metrics.on_rx_error(irq);
+          }
+          if (st != RADIOLIB_ERR_NONE || len == 0) {
+            ESP_LOGW(TAG, "failed to read packet, code %d", st);
+            rx_pool.discard(rx);
+          } else {
+            radio::metrics.on_rx(radio::link_sample(rf));
+            rx->size       = std::min(len, sizeof(rx->data));
+            rx->rx_time_us = dio1_ctx.rx_time_us;
+            rx_pool.submit(rx);
+          }
+          if constexpr (radio::active_profile.rx_mode == radio::rx_mode_t::duty_cycle) {
+            // back to sniffing, as the duty cycle ends with a packet
+            radio::start_receive(rf, radio::active_profile);
+          }
+          xEventGroupSetBits(evt_grp, ParseEvt);
+        }
+      }
+      bool transmitted = false;
+      if (bits & AlarmEvt) {
+        alarm_job_t job;
+        while (xQueueReceive(pending_alarms, &job, 0) == pdTRUE) {
+          uint8_t buf[HrLoRa::hr_alarm::size_needed()];
+          auto sz = HrLoRa::hr_alarm::marshal(job.alarm, buf, sizeof(buf));
+          transmitUrgent(buf, sz, rf);
+          transmitted = true;
+          trace::alarm_latency.record(esp_timer_get_time() - job.detected_us);
+        }
+      }
+      if (bits & TxEvt) {
+        tx_frame_t frame;
+        while (xQueueReceive(pending_tx, &frame, 0) == pdTRUE) {
+          // the later ones also wait for the earlier transmissions
+          if (!transmitted) {
+            trace::wake_tx.record(esp_timer_get_time() - frame.due_us);
+          }
+          tryTransmit(frame.buf, frame.size, rf, frame.is_telemetry);
+          transmitted = true;
+        }
+        while (xQueuePeek(pending_delayed_tx, &frame, 0) == pdTRUE) {
+          const auto now = esp_timer_get_time();
+          if (frame.due_us > now) {
+            esp_timer_stop(delayed_tx_timer);
+            esp_timer_start_once(delayed_tx_timer, frame.due_us - now);
+            break;
+          }
+          xQueueReceive(pending_delayed_tx, &frame, 0);
+          tryTransmit(frame.buf, frame.size, rf, frame.is_telemetry);
+          transmitted = true;
+        }
+      }
+      if (bits & SlotEvt) {
+        trace::wake_slot.record(esp_timer_get_time() - scheduler.slot_us());
+        slot_frame_t frame;
+        HrLoRa::hr_data::t hr_data;
+        if (xQueueReceive(pending_frames, &frame, 0) == pdTRUE) {
+          // a slot carries one frame. piggyback the `hr_data` if the bundle still fits
+          // in the slot, otherwise it waits for the next slot.
+          uint8_t buf[SLOT_FRAME_MAX_SIZE + 32];
+          auto bundle = HrLoRa::bundle::builder(buf, sizeof(buf));
+          // checked before encoding, which takes a sequence number
+          const size_t bundled_size = 1 + (1 + frame.size) + (1 + encoder.frame_size());
+          bool piggybacked          = false;
+          if (bundled_size <= sizeof(buf) &&
+              rf.getTimeOnAir(bundled_size) <= scheduler.slot_length_us() &&
+              xQueueReceive(pending_hr_data, &hr_data, 0) == pdTRUE) {
+            uint8_t hr_buf[16];
+            auto hr_sz  = encoder.encode(hr_data, hr_buf, sizeof(hr_buf));
+            piggybacked = hr_sz != 0 &&
+                          bundle.append(std::span<const uint8_t>{frame.buf, frame.size}) &&
+                          bundle.append(std::span<const uint8_t>{hr_buf, hr_sz});
+          }
+          if (piggybacked) {
+            tryTransmit(buf, bundle.size(), rf);
+          } else {
+            tryTransmit(frame.buf, frame.size, rf);
+          }
+          transmitted = true;
+        } else if (xQueueReceive(pending_hr_data, &hr_data, 0) == pdTRUE) {
+          uint8_t buf[16];
+          auto sz = encoder.encode(hr_data, buf, sizeof(buf));
+          if (sz != 0) {
+            tryTransmit(buf, sz, rf, true);
+            transmitted = true;
+          }
+        }
+      }
+      if (transmitted) {
+        // `tryTransmit` is always followed by receiving
+        listening = true;
+        if constexpr (windowed_rx) {
+          rx_windows.on_uplink();
+        }
+      }
+      if ((bits & RxWinEvt) && rx_windows.is_open() != listening) {
+        if (rx_windows.is_open()) {
+          rf.standby();
+          radio::start_receive(rf, radio::active_profile);
+        } else {
+          // warm start, which keeps the configuration
+          rf.sleep(true);
+        }
+        listening = rx_windows.is_open();
+      }
+      // DIO1 is low again, as the IRQ is cleared by reading, transmitting or (re)starting to receive
+      power::rearm(pin::DIO1);
+    }
+  };
+
+  /**
+   * @brief handle the received packets (and the relays, see `mesh::Relay`) off the radio task
+   * @note the relays are sent with `send_in_slot`
+   */
+  auto parse_task = [](void *) {
+    const auto TAG = "parse";
+    for (;;) {
+      auto bits = xEventGroupWaitBits(evt_grp, ParseEvt | RelayEvt, pdTRUE, pdFALSE, portMAX_DELAY);
+      if (bits & RelayEvt) {
+        uint8_t buf[HrLoRa::relay::max_payload_size + 2];
+        auto sz = relay.pop_due(buf, sizeof(buf));
+        if (sz != 0) {
+          // not in the slots of the others
+          send_in_slot(buf, sz);
+        }
+      }
+      while (auto rx = rx_pool.take()) {
+        if (rx->size != 0) {
+          ESP_LOG_BUFFER_HEX_LEVEL(TAG, rx->data, rx->size, ESP_LOG_DEBUG);
+          parsing_rx_time_us = rx->rx_time_us;
+          handle_message<callbacks>(rx->data, rx->size);
+        }
+        rx_pool.release(rx);
       }
-      ESP_LOGI(TAG, "recv=%s", utils::toHex(data, size).c_str());
-      handle_message(data, size, handle_message_callbacks);
     }
   };
 
@@ -319,22 +1228,77 @@ void app_main() {
       ESP_LOGW(TAG, "hr overflow; cap to 255;");
       hr = 255;
     }
+    // for Bluetooth LE character we just repeat the data
+    hr_char.setValue(data, size);
+    hr_char.notify();
+    const auto now = esp_timer_get_time();
+    if (radio::active_profile.hr_data_link) {
+      // 0 if the controller fails to read it; keep the last known one
+      if (auto rssi = device.client->getRssi(); rssi != 0) {
+        device.rssi = static_cast<int8_t>(rssi);
+      }
+      constexpr auto missing = HrLoRa::hr_data_v2::link_t::missing;
+      auto lora              = radio::metrics.average();
+      encoder.set_link(HrLoRa::hr_data_v2::link_t{
+          .ble_rssi = device.rssi != 0 ? device.rssi : missing,
+          .lora_snr = lora ? lora->snr_qdb : missing,
+      });
+    }
+    if (auto alarm = alarms.feed(*name_map_key_ptr, hr, now)) {
+      auto job = alarm_job_t{.alarm = *alarm, .detected_us = now};
+      ESP_LOGI(TAG, "alarm id=%d level=%d hr=%d", alarm->alarm_id, static_cast<int>(alarm->level), hr);
+      if (xQueueSendToBack(pending_alarms, &job, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "alarm queue full");
+      }
+      notify_radio(AlarmEvt);
+    }
+    if constexpr (HRV_ENABLED) {
+      hrv_analyzer.feed_measurement(data, size);
+      if (auto summary = hrv_reporter.poll(hrv_analyzer, *name_map_key_ptr, now)) {
+        ESP_LOGI(TAG, "rmssd=%dms sdnn=%dms beats=%d rejected=%d", summary->rmssd_ms, summary->sdnn_ms, summary->beats, summary->rejected);
+        uint8_t buf[HrLoRa::hrv_summary::size_needed()];
+        auto sz = HrLoRa::hrv_summary::marshal(*summary, buf, sizeof(buf));
+        send_in_slot(buf, sz);
+      }
+    }
+    // either `hr_data` or `hr_aggregate` is sent. switching drops the open window.
+    static auto last_mode = HrLoRa::set_report_mode::mode_t::raw;
+    const auto mode       = report_mode.load();
+    if (mode != last_mode) {
+      aggregator.reset();
+      last_mode = mode;
+    }
+    if (mode == HrLoRa::set_report_mode::mode_t::aggregate) {
+      if (auto agg = aggregator.feed(*name_map_key_ptr, hr, now)) {
+        ESP_LOGI(TAG, "aggregate min=%d avg=%d max=%d count=%d", agg->min, agg->avg, agg->max, agg->count);
+        uint8_t buf[HrLoRa::hr_aggregate::size_needed()];
+        auto sz = HrLoRa::hr_aggregate::marshal(*agg, buf, sizeof(buf));
+        send_in_slot(buf, sz);
+      }
+      return;
+    }
+    auto reason = policy.feed(hr, now);
+    if (reason == telemetry::report_reason_t::suppressed) {
+      ESP_LOGD(TAG, "suppressed; sent=%zu suppressed=%zu", policy.sent_count(), policy.suppressed_count());
+      return;
+    }
     auto hr_data = HrLoRa::hr_data::t{
         .key = *name_map_key_ptr,
         .hr  = static_cast<uint8_t>(hr),
     };
-    uint8_t buf[16];
-    auto sz = HrLoRa::hr_data::marshal(hr_data, buf, sizeof(buf));
-    if (sz == 0) {
-      ESP_LOGE(TAG, "failed to marshal hr_data");
-      return;
+    if (scheduler.is_synced()) {
+      // wait for the slot of this repeater
+      xQueueOverwrite(pending_hr_data, &hr_data);
+    } else {
+      uint8_t buf[16];
+      // for LoRa we encode the data as `HrLoRa::hr_data` (or `hr_data_v2`, depending on the profile)
+      auto sz = encoder.encode(hr_data, buf, sizeof(buf));
+      if (sz == 0) {
+        ESP_LOGE(TAG, "failed to marshal hr_data");
+        return;
+      }
+      queue_tx(buf, sz, true);
     }
-    rf.standby();
-    // for LoRa we encode the data as `HrLoRa::hr_data`
-    tryTransmit(buf, sz, rf);
-    // for Bluetooth LE character we just repeat the data
-    hr_char.setValue(data, size);
-    hr_char.notify();
   };
 
   /**
@@ -349,6 +1313,7 @@ void app_main() {
   }
 
   scan_manager.start_scanning_task();
-  xTaskCreate(run_recv_task, "recv_task", 4096, &recv_param, 0, &recv_param.handle);
+  xTaskCreate(parse_task, "parse_task", 4096, nullptr, PARSE_TASK_PRIORITY, nullptr);
+  xTaskCreate(run_recv_task, "recv_task", 4096, &recv_param, RADIO_TASK_PRIORITY, &recv_param.handle);
   vTaskDelete(nullptr);
 }
@@ -84,4 +84,34 @@ esp_err_t set_name_map_key(name_map_key_t key) {
   }
   return ESP_OK;
 }
+esp_err_t get_short_addr(short_addr_t *short_addr_ptr) {
+  auto TAG      = "short_addr::get";
+  esp_err_t err = ESP_OK;
+  auto handle   = nvs::open_nvs_handle(common::PREF_PARTITION_LABEL, NVS_READONLY, &err);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "failed to open nvs handle, reason %s (%d)", esp_err_to_name(err), err);
+    return err;
+  }
+  err = handle->get_item(common::PREF_SHORT_ADDR_WORD16_KEY, *short_addr_ptr);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "failed to get short_addr from nvs, reason %s (%d)", esp_err_to_name(err), err);
+    return err;
+  }
+  return ESP_OK;
+}
+esp_err_t set_short_addr(short_addr_t short_addr) {
+  const auto TAG = "short_addr::set";
+  esp_err_t err  = ESP_OK;
+  auto handle    = nvs::open_nvs_handle(common::PREF_PARTITION_LABEL, NVS_READWRITE, &err);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "failed to open nvs handle, reason %s (%d)", esp_err_to_name(err), err);
+    return err;
+  }
+  err = handle->set_item(common::PREF_SHORT_ADDR_WORD16_KEY, short_addr);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "failed to set short_addr from nvs, reason %s (%d)", esp_err_to_name(err), err);
+    return err;
+  }
+  return ESP_OK;
+}
 }
@@ -1,7 +1,10 @@
 //
 // Created by Kurosu Chan on 2023/10/19.
 //
+#include <algorithm>
+#include <cinttypes>
 #include "esp_hal.h"
+
 uint32_t spiFrequencyToClockDiv(uint32_t freq) {
   uint32_t apb_freq = getApbFrequency();
   if (freq >= apb_freq) {
@@ -64,3 +67,97 @@ uint32_t getApbFrequency() {
 
   return ((conf.source_freq_mhz * MHZ) / conf.div);
 }
+
+void IRAM_ATTR ESPHal::radiolibIsr(void *arg) {
+  auto cb = *static_cast<void (**)()>(arg);
+  if (cb != nullptr) {
+    cb();
+  }
+}
+
+esp_err_t ESPHal::attachInterruptArg(uint32_t pin, gpio_isr_t isr, void *arg, uint32_t mode, bool enable) {
+  constexpr auto TAG = "ESPHal::attachInterrupt";
+  if (pin == RADIOLIB_NC) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  auto ret = gpio_install_isr_service((int)ESP_INTR_FLAG_IRAM);
+  // it might be installed already
+  if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+    ESP_LOGE(TAG, "failed to install isr service; %s (%d)", esp_err_to_name(ret), ret);
+    return ret;
+  }
+  const auto gpio = static_cast<gpio_num_t>(pin);
+  gpio_intr_disable(gpio);
+  gpio_set_intr_type(gpio, static_cast<gpio_int_type_t>(mode & 0x7));
+  gpio_isr_handler_remove(gpio);
+  ret = gpio_isr_handler_add(gpio, isr, arg);
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "failed to add isr handler of gpio %" PRIu32 "; %s (%d)", pin, esp_err_to_name(ret), ret);
+    return ret;
+  }
+  if (enable) {
+    gpio_intr_enable(gpio);
+  }
+  return ESP_OK;
+}
+
+void IRAM_ATTR ESPHal::busyIsr(void *arg) {
+  auto &self = *static_cast<ESPHal *>(arg);
+  // level triggered. `waitBusy` unmasks it for the next wait.
+  gpio_intr_disable(static_cast<gpio_num_t>(self.busyPin));
+  BaseType_t task_woken = pdFALSE;
+  xSemaphoreGiveFromISR(self.busySem, &task_woken);
+  portYIELD_FROM_ISR(task_woken);
+}
+
+esp_err_t ESPHal::enableBusyInterrupt(uint32_t pin, const busy_wait_config_t &config) {
+  constexpr auto TAG = "ESPHal::busy";
+  if (pin == RADIOLIB_NC) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (busySem == nullptr) {
+    busySem = xSemaphoreCreateBinary();
+    if (busySem == nullptr) {
+      return ESP_ERR_NO_MEM;
+    }
+  }
+  busyCfg = config;
+  // read by `busyIsr`, so set before the handler is registered
+  busyPin = pin;
+  // BUSY is low while the radio is idle, so the level interrupt is left masked,
+  // and unmasked by `waitBusy` only
+  auto ret = attachInterruptArg(pin, busyIsr, this, GPIO_INTR_LOW_LEVEL, false);
+  if (ret != ESP_OK) {
+    busyPin = RADIOLIB_NC;
+    return ret;
+  }
+  ret = busyLock.init();
+  if (ret != ESP_OK) {
+    ESP_LOGW(TAG, "failed to create pm lock; %s (%d)", esp_err_to_name(ret), ret);
+  }
+  ESP_LOGI(TAG, "gpio %" PRIu32 "; spin %" PRIu32 "us", pin, config.spin_us);
+  return ESP_OK;
+}
+
+bool ESPHal::waitBusy(uint32_t timeout_ms) {
+  if (busyPin == RADIOLIB_NC) {
+    // not enabled
+    return false;
+  }
+  const auto gpio  = static_cast<gpio_num_t>(busyPin);
+  const auto start = esp_timer_get_time();
+  while (gpio_get_level(gpio) && esp_timer_get_time() - start < busyCfg.spin_us) {
+    NOP();
+  }
+  if (gpio_get_level(gpio) && busySem != nullptr) {
+    auto pm = power::LockGuard(busyLock);
+    // a late give from the last wait
+    xSemaphoreTake(busySem, 0);
+    gpio_intr_enable(gpio);
+    // at least one tick, as `pdMS_TO_TICKS` rounds down
+    xSemaphoreTake(busySem, std::max<TickType_t>(pdMS_TO_TICKS(timeout_ms), 1));
+    gpio_intr_disable(gpio);
+  }
+  busyWaitTime.record(esp_timer_get_time() - start);
+  return gpio_get_level(gpio) == 0;
+}
@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <endian.h>
+#include "hrv.h"
+
+namespace hrv {
+namespace {
+  /**
+   * @brief the integer square root, rounded down
+   */
+  constexpr uint64_t isqrt(uint64_t n) {
+    uint64_t result = 0;
+    uint64_t bit    = uint64_t{1} << 62;
+    while (bit > n) {
+      bit >>= 2;
+    }
+    while (bit != 0) {
+      if (n >= result + bit) {
+        n -= result + bit;
+        result = (result >> 1) + bit;
+      } else {
+        result >>= 1;
+      }
+      bit >>= 2;
+    }
+    return result;
+  }
+  static_assert(isqrt(0) == 0 && isqrt(15) == 3 && isqrt(16) == 4 && isqrt(UINT32_MAX) == 65535);
+
+  /**
+   * @brief the square root of `rr_sq_t`, which is exact in `rr_t` up to the rounding
+   */
+  rr_t sqrt(rr_sq_t v) {
+    auto rep = cnl::to_rep(v);
+    return cnl::from_rep<rr_t, int32_t>{}(static_cast<int32_t>(isqrt(rep < 0 ? 0 : rep)));
+  }
+}
+
+void Analyzer::window_t::push(int32_t v, size_t limit) {
+  limit = std::clamp<size_t>(limit, 1, max_window);
+  while (size >= limit) {
+    auto old = values[(head + max_window - size) % max_window];
+    sum -= old;
+    sum_sq -= static_cast<int64_t>(old) * old;
+    size -= 1;
+  }
+  values[head] = v;
+  head         = (head + 1) % max_window;
+  size += 1;
+  sum += v;
+  sum_sq += static_cast<int64_t>(v) * v;
+}
+
+Analyzer::Analyzer(config_t config) : config(config) {}
+
+bool Analyzer::is_artifact(rr_t v) const {
+  if (v < config.min_rr || v > config.max_rr) {
+    return true;
+  }
+  if (!last || rejected_in_row >= config.max_rejected) {
+    return false;
+  }
+  const int64_t d = std::abs(cnl::to_rep(v) - cnl::to_rep(*last));
+  return d * 100 > static_cast<int64_t>(cnl::to_rep(*last)) * config.max_change;
+}
+
+bool Analyzer::feed(rr_t v) {
+  if (is_artifact(v)) {
+    rejected_in_row += 1;
+    _rejected_count += 1;
+    return false;
+  }
+  // a difference across an artifact is not a successive difference
+  if (last && rejected_in_row == 0) {
+    diff.push(cnl::to_rep(v) - cnl::to_rep(*last), config.rmssd_window);
+  }
+  rr.push(cnl::to_rep(v), config.sdnn_window);
+  last            = v;
+  rejected_in_row = 0;
+  return true;
+}
+
+size_t Analyzer::feed_measurement(const uint8_t *data, size_t size) {
+  if (size < 2) {
+    return 0;
+  }
+  const auto flags = data[0];
+  // bit 0: uint16 heart rate; bit 3: energy expended present; bit 4: RR intervals present
+  size_t offset = (flags & 0b1) ? 3 : 2;
+  if (flags & 0b1000) {
+    offset += 2;
+  }
+  if ((flags & 0b10000) == 0) {
+    return 0;
+  }
+  size_t n = 0;
+  for (; offset + 2 <= size; offset += 2, ++n) {
+    feed(from_raw(::le16dec(data + offset)));
+  }
+  return n;
+}
+
+etl::optional<summary_t> Analyzer::summary() const {
+  if (rr.size < 3 || diff.size < 2) {
+    return etl::nullopt;
+  }
+  const auto n = static_cast<int64_t>(rr.size);
+  // the sample variance, i.e. (sum_sq - sum^2 / n) / (n - 1), in rr_sq_t
+  const int64_t var   = (rr.sum_sq * n - rr.sum * rr.sum) / (n * (n - 1));
+  const int64_t ms_sd = diff.sum_sq / static_cast<int64_t>(diff.size);
+  return summary_t{
+      .rmssd = sqrt(cnl::from_rep<rr_sq_t, int64_t>{}(ms_sd)),
+      .sdnn  = sqrt(cnl::from_rep<rr_sq_t, int64_t>{}(var)),
+      .mean  = cnl::from_rep<rr_t, int32_t>{}(static_cast<int32_t>(rr.sum / n)),
+      .beats = static_cast<uint16_t>(rr.size),
+  };
+}
+
+void Analyzer::reset() {
+  rr.clear();
+  diff.clear();
+  last            = etl::nullopt;
+  rejected_in_row = 0;
+  _rejected_count = 0;
+}
+
+etl::optional<HrLoRa::hrv_summary::t> Reporter::poll(const Analyzer &analyzer, HrLoRa::name_map_key_t key, int64_t now_us) {
+  if (!last_us) {
+    last_us = now_us;
+    return etl::nullopt;
+  }
+  if (now_us - *last_us < std::chrono::duration_cast<std::chrono::microseconds>(interval).count()) {
+    return etl::nullopt;
+  }
+  last_us       = now_us;
+  // `rejected_count` restarts from 0 after `Analyzer::reset`
+  auto count    = analyzer.rejected_count();
+  auto rejected = count >= rejected_before ? count - rejected_before : count;
+  auto s        = analyzer.summary();
+  if (!s) {
+    return etl::nullopt;
+  }
+  rejected_before = count;
+  return HrLoRa::hrv_summary::t{
+      .key      = key,
+      .seq      = seq++,
+      .rmssd_ms = to_ms(s->rmssd),
+      .sdnn_ms  = to_ms(s->sdnn),
+      .mean_ms  = to_ms(s->mean),
+      .beats    = static_cast<uint8_t>(std::min<uint16_t>(s->beats, UINT8_MAX)),
+      .rejected = static_cast<uint8_t>(std::min<size_t>(rejected, UINT8_MAX)),
+  };
+}
+}
@@ -0,0 +1,137 @@
+#include <esp_log.h>
+#include <esp_random.h>
+#include "mesh_relay.h"
+
+namespace mesh {
+esp_err_t Relay::init() {
+  if (timer != nullptr) {
+    return ESP_OK;
+  }
+  esp_timer_create_args_t args = {
+      .callback              = timer_cb,
+      .arg                   = this,
+      .dispatch_method       = ESP_TIMER_TASK,
+      .name                  = "relay",
+      .skip_unhandled_events = true,
+  };
+  ESP_RETURN_ON_ERROR(esp_timer_create(&args, &timer), TAG, "failed to create relay timer");
+  return ESP_OK;
+}
+
+void Relay::on_overheard(const uint8_t *data, size_t size, HrLoRa::name_map_key_t own_key) {
+  if (size == 0) {
+    return;
+  }
+  auto frame  = std::span<const uint8_t>{data, size};
+  uint8_t ttl = HrLoRa::relay::max_hops;
+  if (data[0] == HrLoRa::relay::magic) {
+    auto r = HrLoRa::relay::unmarshal(data, size);
+    if (!r) {
+      return;
+    }
+    ttl   = r->ttl;
+    frame = r->payload;
+  }
+  if (!HrLoRa::relay::is_relayable(frame[0]) || frame.size() > HrLoRa::relay::max_payload_size) {
+    return;
+  }
+  auto key = HrLoRa::relay::origin_key(frame);
+  // our own frame, relayed by someone else
+  if (!key || *key == own_key) {
+    return;
+  }
+  const auto now = esp_timer_get_time();
+  auto tag       = HrLoRa::dedupe_tag(frame);
+  if (cache.seen(*key, tag, now / 1000, common::RELAY_DEDUPE_TTL.count())) {
+    // someone has relayed it. cancel ours if still pending
+    for (auto &p : pending) {
+      if (p.active && p.key == *key && p.tag == tag) {
+        p.active = false;
+        // give the reservation back, unless the window has moved on
+        if (p.window_start_us == window_start_us) {
+          airtime_used_us -= p.airtime_us;
+        }
+        _suppressed_count += 1;
+        ESP_LOGD(TAG, "suppress key=%d tag=%04x", *key, tag);
+      }
+    }
+    return;
+  }
+  if (ttl == 0) {
+    return;
+  }
+
+  if (now - window_start_us > common::RELAY_AIRTIME_WINDOW.count() * 1000) {
+    window_start_us = now;
+    airtime_used_us = 0;
+  }
+  const auto frame_size = HrLoRa::relay::size_needed(HrLoRa::relay::t{.ttl = 0, .payload = frame});
+  const auto toa        = time_on_air != nullptr ? time_on_air(frame_size) : 0;
+  if (airtime_used_us + toa > common::RELAY_AIRTIME_BUDGET.count() * 1000) {
+    _suppressed_count += 1;
+    ESP_LOGW(TAG, "airtime budget exhausted; drop key=%d", *key);
+    return;
+  }
+
+  auto it = std::find_if(pending.begin(), pending.end(), [](const pending_t &p) { return !p.active; });
+  if (it == pending.end()) {
+    _suppressed_count += 1;
+    ESP_LOGW(TAG, "queue full; drop key=%d", *key);
+    return;
+  }
+  auto &p = *it;
+  auto sz = HrLoRa::relay::marshal(HrLoRa::relay::t{.ttl = static_cast<uint8_t>(ttl - 1), .payload = frame}, p.buf, sizeof(p.buf));
+  if (sz == 0) {
+    return;
+  }
+  // reserve the airtime when queued, so that a burst won't overshoot the budget
+  airtime_used_us += toa;
+  const auto delay_us = esp_random() % (common::RELAY_MAX_DELAY.count() * 1000 + 1);
+  p.size              = sz;
+  p.due_us            = now + delay_us;
+  p.key               = *key;
+  p.tag               = tag;
+  p.airtime_us        = toa;
+  p.window_start_us   = window_start_us;
+  p.active            = true;
+  rearm();
+}
+
+size_t Relay::pop_due(uint8_t *buffer, size_t size) {
+  const auto now = esp_timer_get_time();
+  size_t sz      = 0;
+  for (auto &p : pending) {
+    if (p.active && p.due_us <= now && p.size <= size) {
+      std::copy(p.buf, p.buf + p.size, buffer);
+      sz       = p.size;
+      p.active = false;
+      _relayed_count += 1;
+      break;
+    }
+  }
+  rearm();
+  return sz;
+}
+
+void Relay::rearm() {
+  esp_timer_stop(timer);
+  int64_t earliest = INT64_MAX;
+  for (const auto &p : pending) {
+    if (p.active && p.due_us < earliest) {
+      earliest = p.due_us;
+    }
+  }
+  if (earliest == INT64_MAX) {
+    return;
+  }
+  const auto now = esp_timer_get_time();
+  esp_timer_start_once(timer, earliest > now ? earliest - now : 0);
+}
+
+void Relay::timer_cb(void *arg) {
+  auto &self = *static_cast<Relay *>(arg);
+  if (self.on_due != nullptr) {
+    self.on_due();
+  }
+}
+}
@@ -0,0 +1,47 @@
+#include <esp_log.h>
+#include <esp_check.h>
+#include <esp_sleep.h>
+#include "power.h"
+
+namespace power {
+static constexpr auto TAG = "power";
+
+Lock radio_tx{ESP_PM_CPU_FREQ_MAX, "radio_tx"};
+Lock ble_event{ESP_PM_CPU_FREQ_MAX, "ble_event"};
+
+esp_err_t Lock::init() {
+#if CONFIG_PM_ENABLE
+  if (handle != nullptr) {
+    return ESP_OK;
+  }
+  return esp_pm_lock_create(type, 0, name, &handle);
+#else
+  return ESP_OK;
+#endif
+}
+
+esp_err_t init(const config_t &config) {
+#if CONFIG_PM_ENABLE
+  esp_pm_config_t pm = {
+      .max_freq_mhz       = config.max_freq_mhz,
+      .min_freq_mhz       = config.min_freq_mhz,
+      .light_sleep_enable = config.light_sleep,
+  };
+  ESP_RETURN_ON_ERROR(esp_pm_configure(&pm), TAG, "failed to configure pm");
+  ESP_RETURN_ON_ERROR(radio_tx.init(), TAG, "failed to create radio_tx lock");
+  ESP_RETURN_ON_ERROR(ble_event.init(), TAG, "failed to create ble_event lock");
+  ESP_LOGI(TAG, "dfs %d-%dMHz; light sleep %s", config.min_freq_mhz, config.max_freq_mhz, config.light_sleep ? "on" : "off");
+#else
+  ESP_LOGI(TAG, "pm disabled; fixed %dMHz", CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+#endif
+  return ESP_OK;
+}
+
+esp_err_t enable_wakeup(gpio_num_t pin) {
+#if CONFIG_PM_ENABLE
+  ESP_RETURN_ON_ERROR(gpio_wakeup_enable(pin, GPIO_INTR_HIGH_LEVEL), TAG, "failed to enable wakeup of gpio %d", pin);
+  ESP_RETURN_ON_ERROR(esp_sleep_enable_gpio_wakeup(), TAG, "failed to enable gpio wakeup");
+#endif
+  return ESP_OK;
+}
+}
@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <cinttypes>
+#include <esp_log.h>
+#include "radio_metrics.h"
+
+namespace radio {
+static constexpr auto TAG = "radio_metrics";
+
+Metrics metrics;
+
+void Metrics::on_rx(const link_sample_t &sample) {
+  taskENTER_CRITICAL(&lock);
+  window[head] = sample;
+  head         = (head + 1) % window_size;
+  filled       = std::min(filled + 1, window_size);
+  counters.rx_count += 1;
+  taskEXIT_CRITICAL(&lock);
+}
+
+void Metrics::on_rx_error(etl::optional<uint16_t> irq) {
+  taskENTER_CRITICAL(&lock);
+  if (irq && (*irq & RADIOLIB_SX126X_IRQ_HEADER_ERR)) {
+    counters.header_errors += 1;
+  } else {
+    counters.crc_errors += 1;
+  }
+  taskEXIT_CRITICAL(&lock);
+}
+
+void Metrics::on_tx_done(int64_t elapsed_us, bool timeout) {
+  tx_time.record(elapsed_us);
+  taskENTER_CRITICAL(&lock);
+  counters.tx_count += 1;
+  if (timeout) {
+    counters.tx_timeouts += 1;
+  }
+  taskEXIT_CRITICAL(&lock);
+}
+
+size_t Metrics::copy_window(window_t &out) const {
+  taskENTER_CRITICAL(&lock);
+  auto n = filled;
+  std::copy(window.begin(), window.end(), out.begin());
+  taskEXIT_CRITICAL(&lock);
+  return n;
+}
+
+HrLoRa::diagnostics_response::t Metrics::snapshot() const {
+  window_t samples;
+  taskENTER_CRITICAL(&lock);
+  auto out = counters;
+  taskEXIT_CRITICAL(&lock);
+  auto n = copy_window(samples);
+  if (n == 0) {
+    return out;
+  }
+  // the order doesn't matter; the first `n` entries are valid until the window is full
+  int32_t rssi_sum = 0;
+  int32_t snr_sum  = 0;
+  int32_t fe_sum   = 0;
+  out.rssi_min     = INT8_MAX;
+  out.rssi_max     = INT8_MIN;
+  out.snr_min      = INT8_MAX;
+  for (size_t i = 0; i < n; ++i) {
+    const auto &s = samples[i];
+    rssi_sum += s.rssi_dbm;
+    snr_sum += s.snr_qdb;
+    fe_sum += s.freq_error_hz;
+    out.rssi_min = std::min(out.rssi_min, s.rssi_dbm);
+    out.rssi_max = std::max(out.rssi_max, s.rssi_dbm);
+    out.snr_min  = std::min(out.snr_min, s.snr_qdb);
+    out.rssi_histogram[HrLoRa::diagnostics_response::rssi_bucket(s.rssi_dbm)] += 1;
+  }
+  const auto count   = static_cast<int32_t>(n);
+  out.rssi_avg       = static_cast<int8_t>(rssi_sum / count);
+  out.snr_avg        = static_cast<int8_t>(snr_sum / count);
+  out.freq_error_avg = static_cast<int16_t>(fe_sum / count);
+  return out;
+}
+
+etl::optional<link_sample_t> Metrics::average() const {
+  window_t samples;
+  auto n = copy_window(samples);
+  if (n == 0) {
+    return etl::nullopt;
+  }
+  int32_t rssi_sum = 0;
+  int32_t snr_sum  = 0;
+  int32_t fe_sum   = 0;
+  for (size_t i = 0; i < n; ++i) {
+    rssi_sum += samples[i].rssi_dbm;
+    snr_sum += samples[i].snr_qdb;
+    fe_sum += samples[i].freq_error_hz;
+  }
+  const auto count = static_cast<int32_t>(n);
+  return link_sample_t{
+      .rssi_dbm      = static_cast<int8_t>(rssi_sum / count),
+      .snr_qdb       = static_cast<int8_t>(snr_sum / count),
+      .freq_error_hz = static_cast<int16_t>(fe_sum / count),
+  };
+}
+
+void Metrics::dump() const {
+  auto s = snapshot();
+  ESP_LOGI(TAG, "rx=%" PRIu16 " crc_err=%" PRIu16 " header_err=%" PRIu16 " tx=%" PRIu16 " tx_timeout=%" PRIu16,
+           s.rx_count, s.crc_errors, s.header_errors, s.tx_count, s.tx_timeouts);
+  ESP_LOGI(TAG, "rssi avg=%d min=%d max=%d dBm; snr avg=%.2f min=%.2f dB; freq_error avg=%d Hz",
+           s.rssi_avg, s.rssi_min, s.rssi_max, s.snr_avg / 4.0, s.snr_min / 4.0, s.freq_error_avg);
+  tx_time.dump();
+}
+}
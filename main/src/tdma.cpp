@@ -0,0 +1,240 @@
+#include <esp_log.h>
+#include "tdma.h"
+#include "common.h"
+
+namespace tdma {
+esp_err_t Scheduler::init() {
+  if (timer != nullptr) {
+    return ESP_OK;
+  }
+  esp_timer_create_args_t args = {
+      .callback              = timer_cb,
+      .arg                   = this,
+      .dispatch_method       = ESP_TIMER_TASK,
+      .name                  = "tdma",
+      .skip_unhandled_events = true,
+  };
+  ESP_RETURN_ON_ERROR(esp_timer_create(&args, &timer), TAG, "failed to create slot timer");
+  return ESP_OK;
+}
+
+void Scheduler::on_beacon(const HrLoRa::beacon::t &beacon, int64_t rx_time_us, HrLoRa::name_map_key_t key) {
+  auto slot = beacon.slot_of(key);
+  if (slot == 0) {
+    ESP_LOGW(TAG, "bad beacon (superframe=%dms, slot=%dms)", beacon.superframe_ms, beacon.slot_ms);
+    desync();
+    return;
+  }
+  const int64_t superframe_us = beacon.superframe_ms * 1000LL;
+  int64_t next                = rx_time_us + slot * beacon.slot_ms * 1000LL;
+  const auto now              = esp_timer_get_time();
+  // the beacon is handled too late to catch the slot in this superframe
+  while (next <= now) {
+    next += superframe_us;
+  }
+  const auto count   = beacon.slot_count();
+  const bool changed = !_is_synced || _beacon.superframe_ms != beacon.superframe_ms || _beacon.slot_ms != beacon.slot_ms;
+  if (changed && key >= count - 1) {
+    // logged once for each layout of the superframe
+    ESP_LOGW(TAG, "key %d wraps around to slot %d/%d, which is shared with key %d", key, slot, count, slot - 1);
+  }
+  esp_timer_stop(timer);
+  portENTER_CRITICAL(&lock);
+  _beacon      = beacon;
+  next_slot_us = next;
+  missed       = 0;
+  _is_synced   = true;
+  portEXIT_CRITICAL(&lock);
+  auto err = esp_timer_start_once(timer, next - now);
+  if (err == ESP_ERR_INVALID_STATE) {
+    // re-armed by `timer_cb` in between, which might also have moved the anchor on
+    esp_timer_stop(timer);
+    portENTER_CRITICAL(&lock);
+    next_slot_us = next;
+    missed       = 0;
+    portEXIT_CRITICAL(&lock);
+    const auto retry_now = esp_timer_get_time();
+    err                  = esp_timer_start_once(timer, next > retry_now ? next - retry_now : 0);
+  }
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "failed to start slot timer; reason %s (%d);", esp_err_to_name(err), err);
+    desync();
+    return;
+  }
+  ESP_LOGD(TAG, "beacon seq=%d; slot=%d/%d", beacon.seq, slot, beacon.slot_count());
+}
+
+bool Scheduler::check_conflict(HrLoRa::name_map_key_t other, HrLoRa::name_map_key_t key) {
+  portENTER_CRITICAL(&lock);
+  const auto beacon = _beacon;
+  const bool synced = _is_synced;
+  portEXIT_CRITICAL(&lock);
+  if (!synced) {
+    return false;
+  }
+  const auto slot = beacon.slot_of(key);
+  if (slot == 0 || beacon.slot_of(other) != slot) {
+    return false;
+  }
+  _conflict_count += 1;
+  ESP_LOGW(TAG, "slot %d is shared with key %d (own key %d); conflicts=%zu", slot, other, key, _conflict_count);
+  return true;
+}
+
+void Scheduler::desync() {
+  esp_timer_stop(timer);
+  portENTER_CRITICAL(&lock);
+  _is_synced = false;
+  portEXIT_CRITICAL(&lock);
+}
+
+void Scheduler::timer_cb(void *arg) {
+  auto &self = *static_cast<Scheduler *>(arg);
+  portENTER_CRITICAL(&self.lock);
+  self.missed += 1;
+  // the beacon of this superframe is counted as missed until it arrives
+  bool lost = self.missed > common::TDMA_MAX_MISSED_BEACONS;
+  if (lost) {
+    self._is_synced = false;
+  }
+  self.last_slot_us = self.next_slot_us;
+  // re-arm relative to the anchored beacon time to avoid drift
+  self.next_slot_us += self._beacon.superframe_ms * 1000LL;
+  auto next = self.next_slot_us;
+  portEXIT_CRITICAL(&self.lock);
+  if (lost) {
+    ESP_LOGW(TAG, "lost beacon; fallback to random access");
+    return;
+  }
+  if (self.on_slot != nullptr) {
+    self.on_slot();
+  }
+  auto now = esp_timer_get_time();
+  esp_timer_start_once(self.timer, next > now ? next - now : 0);
+}
+
+int64_t Scheduler::slot_us() const {
+  portENTER_CRITICAL(&lock);
+  auto slot = last_slot_us;
+  portEXIT_CRITICAL(&lock);
+  return slot;
+}
+
+int64_t Scheduler::slot_length_us() const {
+  portENTER_CRITICAL(&lock);
+  auto slot_ms = _beacon.slot_ms;
+  portEXIT_CRITICAL(&lock);
+  return slot_ms * 1000LL;
+}
+
+esp_err_t RxWindows::init() {
+  if (open_timer != nullptr) {
+    return ESP_OK;
+  }
+  esp_timer_create_args_t open_args = {
+      .callback              = open_cb,
+      .arg                   = this,
+      .dispatch_method       = ESP_TIMER_TASK,
+      .name                  = "rx_open",
+      .skip_unhandled_events = true,
+  };
+  ESP_RETURN_ON_ERROR(esp_timer_create(&open_args, &open_timer), TAG, "failed to create open timer");
+  esp_timer_create_args_t close_args = {
+      .callback              = close_cb,
+      .arg                   = this,
+      .dispatch_method       = ESP_TIMER_TASK,
+      .name                  = "rx_close",
+      .skip_unhandled_events = true,
+  };
+  ESP_RETURN_ON_ERROR(esp_timer_create(&close_args, &close_timer), TAG, "failed to create close timer");
+  return ESP_OK;
+}
+
+void RxWindows::set_open(bool open) {
+  if (_is_open.exchange(open) != open && on_change != nullptr) {
+    on_change();
+  }
+}
+
+void RxWindows::on_beacon(const HrLoRa::beacon::t &beacon, int64_t rx_time_us) {
+  const int64_t superframe_us = beacon.superframe_ms * 1000LL;
+  if (superframe_us <= guard_us + window_us) {
+    ESP_LOGW(TAG, "superframe (%dms) is too short for the windows", beacon.superframe_ms);
+    desync();
+    return;
+  }
+  int64_t next   = rx_time_us + superframe_us - guard_us;
+  const auto now = esp_timer_get_time();
+  while (next <= now) {
+    next += superframe_us;
+  }
+  esp_timer_stop(open_timer);
+  esp_timer_stop(close_timer);
+  portENTER_CRITICAL(&lock);
+  this->superframe_us = superframe_us;
+  next_open_us        = next;
+  missed              = 0;
+  _is_synced          = true;
+  portEXIT_CRITICAL(&lock);
+  const int64_t close_us = rx_time_us + window_us;
+  set_open(close_us > now);
+  esp_timer_start_once(open_timer, next - now);
+  if (close_us > now) {
+    esp_timer_start_once(close_timer, close_us - now);
+  }
+}
+
+void RxWindows::on_uplink() {
+  portENTER_CRITICAL(&lock);
+  bool synced = _is_synced;
+  portEXIT_CRITICAL(&lock);
+  if (!synced) {
+    return;
+  }
+  esp_timer_stop(close_timer);
+  set_open(true);
+  esp_timer_start_once(close_timer, window_us);
+}
+
+void RxWindows::desync() {
+  esp_timer_stop(open_timer);
+  esp_timer_stop(close_timer);
+  portENTER_CRITICAL(&lock);
+  _is_synced = false;
+  portEXIT_CRITICAL(&lock);
+  set_open(true);
+}
+
+void RxWindows::open_cb(void *arg) {
+  auto &self = *static_cast<RxWindows *>(arg);
+  portENTER_CRITICAL(&self.lock);
+  self.missed += 1;
+  // the beacon of this window is counted as missed until it arrives
+  bool lost = self.missed > common::TDMA_MAX_MISSED_BEACONS;
+  if (lost) {
+    self._is_synced = false;
+  }
+  self.next_open_us += self.superframe_us;
+  auto next = self.next_open_us;
+  portEXIT_CRITICAL(&self.lock);
+  esp_timer_stop(self.close_timer);
+  self.set_open(true);
+  if (lost) {
+    ESP_LOGW(TAG, "lost beacon; fallback to continuous receive");
+    return;
+  }
+  auto now = esp_timer_get_time();
+  esp_timer_start_once(self.open_timer, next > now ? next - now : 0);
+  esp_timer_start_once(self.close_timer, self.guard_us + self.window_us);
+}
+
+void RxWindows::close_cb(void *arg) {
+  auto &self = *static_cast<RxWindows *>(arg);
+  portENTER_CRITICAL(&self.lock);
+  bool synced = self._is_synced;
+  portEXIT_CRITICAL(&self.lock);
+  if (synced) {
+    self.set_open(false);
+  }
+}
+}
@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <cstdlib>
+#include "telemetry.h"
+
+namespace telemetry {
+size_t Encoder::frame_size() const {
+  if (profile.hr_data_version == 2) {
+    return HrLoRa::hr_data_v2::size_needed(profile.hr_data_link);
+  }
+  if (profile.hr_data_version == 3) {
+    return HrLoRa::hr_data_redundant::size_needed(profile.hr_data_history);
+  }
+  return HrLoRa::hr_data::size_needed();
+}
+
+size_t Encoder::encode(const HrLoRa::hr_data::t &sample, uint8_t *buffer, size_t size) {
+  size_t sz = 0;
+  if (profile.hr_data_version == 2) {
+    auto data = HrLoRa::hr_data_v2::t{
+        .key = sample.key,
+        .seq = seq.fetch_add(1),
+        .hr  = sample.hr,
+    };
+    if (profile.hr_data_link) {
+      taskENTER_CRITICAL(&lock);
+      data.link = link;
+      taskEXIT_CRITICAL(&lock);
+    }
+    sz = HrLoRa::hr_data_v2::marshal(data, buffer, size);
+  } else if (profile.hr_data_version == 3) {
+    sz = encode_redundant(sample, buffer, size);
+  } else {
+    sz = HrLoRa::hr_data::marshal(sample, buffer, size);
+  }
+  if (sz != 0) {
+    _encoded_count += 1;
+  }
+  return sz;
+}
+
+size_t Encoder::encode_redundant(const HrLoRa::hr_data::t &sample, uint8_t *buffer, size_t size) {
+  auto data = HrLoRa::hr_data_redundant::t{
+      .key   = sample.key,
+      .hr    = sample.hr,
+      .count = profile.hr_data_history,
+  };
+  if (size < HrLoRa::hr_data_redundant::size_needed(data)) {
+    return 0;
+  }
+  // the sequence number and the history must be taken together, or a frame
+  // encoded concurrently would be carried with a wrong sequence number
+  taskENTER_CRITICAL(&lock);
+  data.seq     = seq.fetch_add(1);
+  data.history = history;
+  std::copy_backward(history.begin(), history.end() - 1, history.end());
+  history[0] = sample.hr;
+  taskEXIT_CRITICAL(&lock);
+  return HrLoRa::hr_data_redundant::marshal(data, buffer, size);
+}
+
+void Encoder::set_link(const HrLoRa::hr_data_v2::link_t &link) {
+  taskENTER_CRITICAL(&lock);
+  this->link = link;
+  taskEXIT_CRITICAL(&lock);
+}
+
+bool ReportPolicy::is_throttled(int64_t now_us) const {
+  const int64_t interval_us = min_interval_ms.load() * 1000LL;
+  const int64_t until_us    = min_interval_until_us.load();
+  if (interval_us == 0 || (until_us != 0 && now_us >= until_us)) {
+    return false;
+  }
+  return now_us - last_reported_us < interval_us;
+}
+
+etl::optional<HrLoRa::hr_aggregate::t> Aggregator::feed(HrLoRa::name_map_key_t key, uint8_t hr, int64_t now_us) {
+  etl::optional<HrLoRa::hr_aggregate::t> closed = etl::nullopt;
+  if (start_us && now_us - *start_us >= window_s * 1'000'000LL) {
+    if (count != 0) {
+      closed = HrLoRa::hr_aggregate::t{
+          .key      = key,
+          .seq      = seq++,
+          .min      = min,
+          .avg      = static_cast<uint8_t>((sum + count / 2) / count),
+          .max      = max,
+          .count    = count,
+          .window_s = window_s,
+      };
+    }
+    reset();
+  }
+  if (!start_us) {
+    start_us = now_us;
+    window_s = next_window_s.load();
+  }
+  min = std::min(min, hr);
+  max = std::max(max, hr);
+  if (count < UINT16_MAX) {
+    sum += hr;
+    count += 1;
+  }
+  return closed;
+}
+
+etl::optional<HrLoRa::hr_alarm::t> AlarmDetector::feed(HrLoRa::name_map_key_t key, uint8_t hr, int64_t now_us) {
+  using level_t = HrLoRa::hr_alarm::level_t;
+  if (hr == 0) {
+    // no skin contact, which is not a low heart rate
+    return etl::nullopt;
+  }
+  auto l = level_of(hr);
+  // the hysteresis around the threshold of the current alarm
+  if (level == level_t::high && l == level_t::normal && hr + config.alarm_rearm_band >= config.high_threshold) {
+    l = level_t::high;
+  } else if (level == level_t::low && l == level_t::normal && hr < config.low_threshold + config.alarm_rearm_band) {
+    l = level_t::low;
+  }
+  if (l == level) {
+    return etl::nullopt;
+  }
+  auto &last              = last_raised_us[static_cast<size_t>(l)];
+  const auto min_interval = std::chrono::duration_cast<std::chrono::microseconds>(config.alarm_min_interval).count();
+  if (last && now_us - *last < min_interval) {
+    _held_back_count += 1;
+    return etl::nullopt;
+  }
+  last  = now_us;
+  level = l;
+  return HrLoRa::hr_alarm::t{
+      .key      = key,
+      .alarm_id = alarm_id++,
+      .level    = l,
+      .hr       = hr,
+  };
+}
+
+report_reason_t ReportPolicy::feed(uint8_t hr, int64_t now_us) {
+  auto crossed = [this, hr](uint8_t threshold) {
+    return last_seen && ((*last_seen < threshold) != (hr < threshold));
+  };
+  auto reason = report_reason_t::suppressed;
+  if (!last_reported) {
+    reason = report_reason_t::first;
+  } else if (crossed(config.low_threshold) || crossed(config.high_threshold)) {
+    reason = report_reason_t::threshold;
+  } else if (std::abs(hr - *last_reported) > config.dead_band) {
+    reason = report_reason_t::changed;
+  } else if (now_us - last_reported_us >= std::chrono::duration_cast<std::chrono::microseconds>(config.max_silence).count()) {
+    reason = report_reason_t::silence;
+  }
+  if ((reason == report_reason_t::changed || reason == report_reason_t::silence) && is_throttled(now_us)) {
+    reason = report_reason_t::suppressed;
+    _throttled_count += 1;
+  }
+  last_seen = hr;
+  if (reason == report_reason_t::suppressed) {
+    _suppressed_count += 1;
+  } else {
+    last_reported    = hr;
+    last_reported_us = now_us;
+    _sent_count += 1;
+  }
+  return reason;
+}
+}
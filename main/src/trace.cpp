@@ -0,0 +1,64 @@
+#include <bit>
+#include <algorithm>
+#include <cinttypes>
+#include <esp_log.h>
+#include "trace.h"
+
+namespace trace {
+static constexpr auto TAG = "trace";
+
+Histogram alarm_latency{"alarm"};
+Histogram wake_dio1{"wake_dio1"};
+Histogram wake_slot{"wake_slot"};
+Histogram wake_tx{"wake_tx"};
+Histogram ble_notify{"ble_notify"};
+
+void Histogram::record(int64_t us) {
+  const uint32_t v = us <= 0 ? 0 : static_cast<uint32_t>(std::min<int64_t>(us, UINT32_MAX));
+  const size_t i   = std::min<size_t>(std::bit_width(v), bucket_count - 1);
+  buckets[i] += 1;
+  _count += 1;
+  auto prev = _max_us.load();
+  while (v > prev && !_max_us.compare_exchange_weak(prev, v)) {}
+}
+
+uint32_t Histogram::percentile_us(uint8_t p) const {
+  const uint32_t total = _count;
+  if (total == 0) {
+    return 0;
+  }
+  // the rank of the sample, rounded up
+  const uint64_t rank = (static_cast<uint64_t>(total) * std::min<uint8_t>(p, 100) + 99) / 100;
+  uint64_t seen       = 0;
+  for (size_t i = 0; i < bucket_count; ++i) {
+    seen += buckets[i];
+    if (seen >= rank && seen != 0) {
+      return i == bucket_count - 1 ? max_us() : (1u << i);
+    }
+  }
+  return max_us();
+}
+
+void Histogram::dump() const {
+  ESP_LOGI(TAG, "%s: count=%" PRIu32 " p50<%" PRIu32 "us p99<%" PRIu32 "us max=%" PRIu32 "us",
+           _name, count(), percentile_us(50), percentile_us(99), max_us());
+  for (size_t i = 0; i < bucket_count; ++i) {
+    uint32_t n = buckets[i];
+    if (n == 0) {
+      continue;
+    }
+    const uint32_t lower = i == 0 ? 0 : (1u << (i - 1));
+    if (i == bucket_count - 1) {
+      ESP_LOGD(TAG, "%s: [%" PRIu32 ", inf)us %" PRIu32, _name, lower, n);
+    } else {
+      ESP_LOGD(TAG, "%s: [%" PRIu32 ", %" PRIu32 ")us %" PRIu32, _name, lower, 1u << i, n);
+    }
+  }
+}
+
+void dump_wake_latency() {
+  for (auto h : {&wake_dio1, &wake_slot, &wake_tx, &ble_notify}) {
+    h->dump();
+  }
+}
+}